@@ -0,0 +1,163 @@
+#include "batchio.hh"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+static void setupBuffers(vector<char>& packets, vector<ComboAddress>& addrs, vector<struct iovec>& iovecs, vector<struct mmsghdr>& msgs, unsigned int batchsize, size_t mtu)
+{
+  packets.resize(batchsize * mtu);
+  addrs.resize(batchsize);
+  iovecs.resize(batchsize);
+  msgs.resize(batchsize);
+  for(unsigned int n = 0; n < batchsize; ++n) {
+    iovecs[n].iov_base = &packets[n * mtu];
+    iovecs[n].iov_len = mtu;
+    memset(&msgs[n], 0, sizeof(msgs[n]));
+    msgs[n].msg_hdr.msg_name = &addrs[n];
+    msgs[n].msg_hdr.msg_namelen = sizeof(addrs[n]);
+    msgs[n].msg_hdr.msg_iov = &iovecs[n];
+    msgs[n].msg_hdr.msg_iovlen = 1;
+  }
+}
+
+// points every message at its own control buffer, of the full size
+static void setupControl(vector<PacketInfoBuffer>& control, vector<struct mmsghdr>& msgs)
+{
+  control.resize(msgs.size());
+  for(unsigned int n = 0; n < msgs.size(); ++n) {
+    msgs[n].msg_hdr.msg_control = &control[n];
+    msgs[n].msg_hdr.msg_controllen = sizeof(control[n]);
+  }
+}
+
+UDPBatchSender::UDPBatchSender(int sock, unsigned int batchsize, size_t mtu, bool sources) : d_sock(sock), d_mtu(mtu)
+{
+  setupBuffers(d_packets, d_addrs, d_iovecs, d_msgs, max(batchsize, 1U), mtu);
+  if(sources)
+    setupControl(d_control, d_msgs);
+}
+
+void UDPBatchSender::add(const char* packet, size_t len, const ComboAddress& dest)
+{
+  if(len > d_mtu)
+    throw runtime_error("Packet of "+to_string(len)+" bytes does not fit in batch buffer of "+to_string(d_mtu));
+  memcpy(buffer(), packet, len);
+  add(len, dest);
+}
+
+void UDPBatchSender::add(size_t len, const ComboAddress& dest)
+{
+  if(full())
+    throw runtime_error("Adding packet to a full batch");
+  d_addrs[d_queued] = dest;
+  d_iovecs[d_queued].iov_len = len;
+  d_msgs[d_queued].msg_hdr.msg_namelen = dest.getSocklen();
+  if(!d_control.empty())
+    d_msgs[d_queued].msg_hdr.msg_controllen = 0;
+  ++d_queued;
+}
+
+void UDPBatchSender::add(size_t len, const ComboAddress& dest, uint32_t source)
+{
+  if(d_control.empty())
+    throw runtime_error("Adding packet with a source address to a batch without sources");
+  unsigned int n = d_queued;
+  add(len, dest);
+  memset(&d_control[n], 0, sizeof(d_control[n]));
+  struct cmsghdr* cmsg = &d_control[n].align;
+  cmsg->cmsg_level = IPPROTO_IP;
+  cmsg->cmsg_type = IP_PKTINFO;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+  struct in_pktinfo info{};
+  info.ipi_spec_dst.s_addr = htonl(source);
+  memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+  d_msgs[n].msg_hdr.msg_controllen = sizeof(d_control[n]);
+}
+
+unsigned int UDPBatchSender::flush(const Refused& refused)
+{
+  unsigned int sent = 0;
+  d_congested = false;
+  while(sent < d_queued) {
+    int res = sendmmsg(d_sock, &d_msgs[sent], d_queued - sent, 0);
+    ++d_syscalls;
+    if(res < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      // raw sockets get this when the device queue is full, instead of blocking
+      if(errno == ENOBUFS) {
+        d_congested = true;
+        break;
+      }
+      // the first packet was refused, because of its destination, so skip it
+      if(errno == EPERM || errno == EACCES || errno == ENETUNREACH || errno == EHOSTUNREACH || errno == ECONNREFUSED) {
+        ++d_errors;
+        if(refused)
+          refused(sent);
+        ++sent;
+        continue;
+      }
+      throw runtime_error(string("sendmmsg: ")+strerror(errno));
+    }
+    sent += res;
+  }
+  if(sent < d_queued) { // keep the unsent ones queued, at the front
+    for(unsigned int n = sent; n < d_queued; ++n) {
+      memcpy(&d_packets[(n - sent) * d_mtu], &d_packets[n * d_mtu], d_iovecs[n].iov_len);
+      d_addrs[n - sent] = d_addrs[n];
+      d_iovecs[n - sent].iov_len = d_iovecs[n].iov_len;
+      d_msgs[n - sent].msg_hdr.msg_namelen = d_msgs[n].msg_hdr.msg_namelen;
+      if(!d_control.empty()) {
+        d_control[n - sent] = d_control[n];
+        d_msgs[n - sent].msg_hdr.msg_controllen = d_msgs[n].msg_hdr.msg_controllen;
+      }
+    }
+  }
+  d_queued -= sent;
+  return sent;
+}
+
+UDPBatchReceiver::UDPBatchReceiver(int sock, unsigned int batchsize, size_t mtu, bool destinations) : d_sock(sock), d_mtu(mtu)
+{
+  setupBuffers(d_packets, d_addrs, d_iovecs, d_msgs, max(batchsize, 1U), mtu);
+  if(destinations) {
+    SSetsockopt(sock, IPPROTO_IP, IP_PKTINFO, 1);
+    setupControl(d_control, d_msgs);
+  }
+}
+
+uint32_t UDPBatchReceiver::destination(unsigned int n) const
+{
+  const struct msghdr* msg = &d_msgs[n].msg_hdr;
+  for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR((struct msghdr*)msg, cmsg)) {
+    if(cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+      struct in_pktinfo info;
+      memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+      return ntohl(info.ipi_addr.s_addr);
+    }
+  }
+  return 0;
+}
+
+unsigned int UDPBatchReceiver::receive(int flags)
+{
+  for(auto& m : d_msgs) {
+    m.msg_hdr.msg_namelen = sizeof(ComboAddress);
+    if(!d_control.empty())
+      m.msg_hdr.msg_controllen = sizeof(PacketInfoBuffer);
+  }
+  for(;;) {
+    int res = recvmmsg(d_sock, &d_msgs[0], d_msgs.size(), flags, nullptr);
+    ++d_syscalls;
+    if(res >= 0)
+      return res;
+    if(errno == EINTR)
+      continue;
+    if(errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    throw runtime_error(string("recvmmsg: ")+strerror(errno));
+  }
+}
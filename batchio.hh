@@ -0,0 +1,147 @@
+#pragma once
+#include "swrappers.hh"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+//! room for one IP_PKTINFO control message
+union PacketInfoBuffer
+{
+  struct cmsghdr align;
+  char buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
+};
+
+/** Queues UDP datagrams and sends them with as few sendmmsg() calls as possible.
+    Packet and address buffers are allocated once, up front. With 'sources', every
+    packet can be sent from an IPv4 address of its own, through IP_PKTINFO. */
+class UDPBatchSender
+{
+public:
+  UDPBatchSender(int sock, unsigned int batchsize = 64, size_t mtu = 512, bool sources = false);
+  UDPBatchSender(const UDPBatchSender&) = delete;
+
+  //! copies packet into the queue, which must not be full
+  void add(const char* packet, size_t len, const ComboAddress& dest);
+  void add(const std::string& packet, const ComboAddress& dest)
+  {
+    add(packet.c_str(), packet.size(), dest);
+  }
+
+  //! room for the next packet, which add(len, dest) then queues without copying
+  char* buffer()
+  {
+    return &d_packets[d_queued * d_mtu];
+  }
+  void add(size_t len, const ComboAddress& dest);
+  //! only with 'sources', source in host byte order
+  void add(size_t len, const ComboAddress& dest, uint32_t source);
+
+  //! gets the index of a refused packet in the queue as it was when flush() started
+  typedef std::function<void(unsigned int n)> Refused;
+
+  /** sends everything queued. On a non-blocking socket this may stop short, and it also
+      stops short when the kernel is out of buffers, see congested(). Returns the number
+      of packets off the queue, including those the kernel refused to send to their
+      destination, which are dropped and counted in errors(). 'refused' is called for
+      those while packet() and dest() still have them */
+  unsigned int flush(const Refused& refused = Refused());
+
+  //! the last flush() stopped on ENOBUFS, which poll() does not say the end of
+  bool congested() const
+  {
+    return d_congested;
+  }
+
+  unsigned int queued() const
+  {
+    return d_queued;
+  }
+  const char* packet(unsigned int n) const
+  {
+    return &d_packets[n * d_mtu];
+  }
+  const ComboAddress& dest(unsigned int n) const
+  {
+    return d_addrs[n];
+  }
+  bool full() const
+  {
+    return d_queued == d_msgs.size();
+  }
+  size_t mtu() const
+  {
+    return d_mtu;
+  }
+  int getSocket() const
+  {
+    return d_sock;
+  }
+  //! sendmmsg() calls so far, including those that failed
+  uint64_t syscalls() const
+  {
+    return d_syscalls;
+  }
+  uint64_t errors() const
+  {
+    return d_errors;
+  }
+
+private:
+  int d_sock;
+  size_t d_mtu;
+  unsigned int d_queued{0};
+  bool d_congested{false};
+  uint64_t d_syscalls{0}, d_errors{0};
+  std::vector<char> d_packets;
+  std::vector<ComboAddress> d_addrs;
+  std::vector<struct iovec> d_iovecs;
+  std::vector<struct mmsghdr> d_msgs;
+  std::vector<PacketInfoBuffer> d_control; //<! only with 'sources'
+};
+
+/** Receives up to a batch of UDP datagrams per recvmmsg() call, into buffers
+    that are allocated once and reused. With 'destinations', IP_PKTINFO is turned on for
+    the socket, so it is known which IPv4 address each datagram was sent to. */
+class UDPBatchReceiver
+{
+public:
+  UDPBatchReceiver(int sock, unsigned int batchsize = 64, size_t mtu = 1500, bool destinations = false);
+  UDPBatchReceiver(const UDPBatchReceiver&) = delete;
+
+  /** By default blocks until there is at least one datagram, and then takes whatever else
+      is waiting. Returns the number received, 0 if a non-blocking socket had nothing. */
+  unsigned int receive(int flags = MSG_WAITFORONE);
+
+  const char* data(unsigned int n) const
+  {
+    return &d_packets[n * d_mtu];
+  }
+  size_t size(unsigned int n) const
+  {
+    return d_msgs[n].msg_len;
+  }
+  const ComboAddress& from(unsigned int n) const
+  {
+    return d_addrs[n];
+  }
+  //! only with 'destinations', in host byte order, 0 if the kernel did not say
+  uint32_t destination(unsigned int n) const;
+  //! recvmmsg() calls so far, including those that failed
+  uint64_t syscalls() const
+  {
+    return d_syscalls;
+  }
+
+private:
+  int d_sock;
+  size_t d_mtu;
+  uint64_t d_syscalls{0};
+  std::vector<PacketInfoBuffer> d_control; //<! only with 'destinations'
+  std::vector<char> d_packets;
+  std::vector<ComboAddress> d_addrs;
+  std::vector<struct iovec> d_iovecs;
+  std::vector<struct mmsghdr> d_msgs;
+};
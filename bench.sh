@@ -0,0 +1,56 @@
+#!/bin/sh
+# Runs dnsscan against dnssim in a network namespace of its own, where every IPv4
+# address is local, and compares the estimates with what dnssim knows to be true.
+# Needs root for the namespace.
+#
+#   ./bench.sh prefixesfile [dnsscan options]
+#
+# dnssim options go in DNSSIM_OPTS, say DNSSIM_OPTS="--threads 2 --rtt 20 --jitter 30".
+set -e
+if [ $# -lt 1 ]; then
+	echo "Syntax: bench.sh prefixesfile [dnsscan options]" >&2
+	exit 1
+fi
+bin=$(cd "$(dirname "$0")" && pwd)
+prefixes=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+shift
+
+if [ -z "$BENCH_NETNS" ]; then
+	exec unshare -n env BENCH_NETNS=1 "$0" "$prefixes" "$@"
+fi
+ip link set lo up
+ip route add local 0.0.0.0/0 dev lo
+
+dir=$(mktemp -d)
+cd "$dir"
+"$bin/dnssim" $DNSSIM_OPTS "$prefixes" > sim.log &
+sim=$!
+trap 'kill $sim 2>/dev/null; rm -rf "$dir"' EXIT
+while ! grep -q '^Listening' sim.log; do
+	kill -0 $sim
+	sleep 0.1
+done
+
+"$bin/dnsscan" "$@" "$prefixes" > scan.log
+grep -v '^[0-9]*$' scan.log
+tail -n 1 sim.log
+grep '^Observable' sim.log || true
+
+# the estimates are the first number on their line, the open resolver one the first after 'responding,'
+awk -v truth="$(grep '^Truth' sim.log)" '
+BEGIN {
+	split(truth, t, " ")
+	resp = t[2] + 0
+	open = t[4] + 0
+	printf("\nTruth: %.4f%% responding, %.4f%% open resolvers\n", resp, open)
+}
+/^(random|Sobol|combined):/ {
+	method = $1
+	r = $2 + 0
+	for(n = 3; n <= NF; ++n)
+		if($n == "responding,") {
+			o = $(n + 1) + 0
+			break
+		}
+	printf("%-12s error %+.4f points responding, %+.4f points open resolvers\n", method, r - resp, o - open)
+}' scan.log
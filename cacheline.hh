@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+
+/* Data that one thread writes and others read is kept off its neighbours' cache lines
+   with padding rather than alignas: this is built as C++14, where std::allocator and
+   new ignore alignment beyond that of max_align_t, so an alignas member would not
+   stay aligned in a vector or on the heap. */
+
+constexpr size_t g_cacheLine = 64;
+
+//! fills up the rest of a cache line after 'used' bytes, or a whole line if 'used' is a multiple
+template<size_t used = 0>
+struct CacheLinePad
+{
+  char pad[g_cacheLine - used % g_cacheLine];
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include "sobol.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+/* Generators of candidate IPv4 addresses, in host byte order. These produce plain
+   integers, so no strings get formatted or parsed per candidate. */
+
+//! Four Sobol dimensions, one per octet
+class SobolIPv4Generator
+{
+public:
+  explicit SobolIPv4Generator(uint64_t seed = 0) : d_sg(4, seed)
+  {}
+
+  uint32_t next()
+  {
+    uint32_t x[4];
+    d_sg.next(x);
+    return pack(x);
+  }
+
+  void fill(uint32_t* ips, size_t n)
+  {
+    uint32_t x[4 * 256];
+    for(size_t i = 0; i < n; i += 256) {
+      size_t num = std::min(n - i, (size_t)256);
+      d_sg.fill(x, num);
+      for(size_t j = 0; j < num; ++j)
+        ips[i + j] = pack(x + 4 * j);
+    }
+  }
+
+  void seek(uint64_t index)
+  {
+    d_sg.seek(index);
+  }
+
+private:
+  static uint32_t pack(const uint32_t* x)
+  {
+    return (x[0] & 0xff000000) | ((x[1] >> 8) & 0xff0000) | ((x[2] >> 16) & 0xff00) | (x[3] >> 24);
+  }
+
+  SobolGenerator d_sg;
+};
+
+/** A single 32-bit Sobol dimension, which is the van der Corput sequence in Gray code order.
+    Every 2^k consecutive points hit each /k exactly once, and 2^32 points cover everything. */
+class LinearSobolIPv4Generator
+{
+public:
+  explicit LinearSobolIPv4Generator(uint64_t seed = 0) : d_sg(1, seed)
+  {}
+
+  uint32_t next()
+  {
+    uint32_t ret;
+    d_sg.next(&ret);
+    return ret;
+  }
+
+  void fill(uint32_t* ips, size_t n)
+  {
+    d_sg.fill(ips, n);
+  }
+
+  void seek(uint64_t index)
+  {
+    d_sg.seek(index);
+  }
+
+private:
+  SobolGenerator d_sg;
+};
+
+//! Uniformly random addresses
+class RandomIPv4Generator
+{
+public:
+  explicit RandomIPv4Generator(uint32_t seed) : d_gen(seed)
+  {}
+
+  uint32_t next()
+  {
+    return d_gen();
+  }
+
+  void fill(uint32_t* ips, size_t n)
+  {
+    for(size_t i = 0; i < n; ++i)
+      ips[i] = d_gen();
+  }
+
+private:
+  std::mt19937 d_gen;
+};
@@ -1,6 +1,9 @@
 #include "common.hh"
 #include "netmask.hh"
+#include "prefixfile.hh"
 #include <fstream>
+#include <iostream>
+#include <stdexcept>
 using namespace std;
 
 void loadNetmaskTree(const std::string& name, NetmaskTree<bool> &table)
@@ -17,3 +20,29 @@ void loadNetmaskTree(const std::string& name, NetmaskTree<bool> &table)
       table.insert(nm);
   }
 }
+
+std::vector<IPv4Prefix> loadIPv4Prefixes(const std::string& name)
+{
+  vector<IPv4Prefix> ret;
+  auto stats = parsePrefixFile(name, &ret, nullptr);
+  if(stats.malformed) {
+    cerr<<"Warning: skipped "<<stats.malformed<<" malformed line"<<(stats.malformed > 1 ? "s" : "")<<" in '"<<name<<"':"<<endl;
+    for(const auto& e : stats.examples)
+      cerr<<"  line "<<e.first<<": "<<e.second<<endl;
+  }
+  return ret;
+}
+
+IPv4Table loadIPv4Table(const std::string& name)
+{
+  if(IPv4Table::isSnapshot(name))
+    return IPv4Table::load(name);
+  return IPv4Table(loadIPv4Prefixes(name));
+}
+
+PrefixSet loadPrefixSet(const std::string& name)
+{
+  if(IPv4Table::isSnapshot(name))
+    throw runtime_error("'"+name+"' is a snapshot, which only holds a lookup table, please use the prefixes file");
+  return PrefixSet(loadIPv4Prefixes(name));
+}
@@ -1,6 +1,24 @@
 #pragma once
 
 #include "netmask.hh"
+#include "iptable.hh"
+#include "prefixset.hh"
 #include <string>
+#include <vector>
 
 void loadNetmaskTree(const std::string& name, NetmaskTree<bool> &table);
+std::vector<IPv4Prefix> loadIPv4Prefixes(const std::string& name);
+//<! maps name if it is a snapshot written by compileprefixes, parses it as a prefixes file otherwise
+IPv4Table loadIPv4Table(const std::string& name);
+//<! the IPv4 prefixes in a prefixes file as a set, throws for snapshots
+PrefixSet loadPrefixSet(const std::string& name);
+
+//<! ip in host byte order
+inline ComboAddress makeComboAddress(uint32_t ip, uint16_t port)
+{
+  ComboAddress ret;
+  ret.sin4.sin_family = AF_INET;
+  ret.sin4.sin_addr.s_addr = htonl(ip);
+  ret.sin4.sin_port = htons(port);
+  return ret;
+}
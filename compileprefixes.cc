@@ -0,0 +1,29 @@
+#include <iostream>
+#include "common.hh"
+using namespace std;
+
+// turns a prefixes file into a snapshot that makemap and dnsscan can map without parsing
+
+int main(int argc, char**argv)
+{
+  if(argc != 3 && argc != 4) {
+    cout<<"Syntax: compileprefixes prefixesfile snapshot [excludefile]\n";
+    return EXIT_FAILURE;
+  }
+  try {
+    auto prefixes = loadIPv4Prefixes(argv[1]);
+    PrefixSet set(prefixes);
+    cout<<"Read "<<prefixes.size()<<" netmasks, "<<set.ranges().size()<<" distinct ranges"<<endl;
+    if(argc == 4) {
+      set = set.subtract(loadPrefixSet(argv[3]));
+      cout<<"Left "<<set.ranges().size()<<" ranges after exclusions"<<endl;
+    }
+    IPv4Table table(set.prefixes());
+    table.save(argv[2]);
+    cout<<"Wrote "<<table.addressCount()<<" addresses to '"<<argv[2]<<"'"<<endl;
+  }
+  catch(std::exception& e) {
+    cerr<<"Error: "<<e.what()<<endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,92 @@
+#include "dnsclassify.hh"
+#include <cctype>
+using namespace std;
+
+namespace {
+uint16_t get16(const char* p)
+{
+  return ((uint8_t)p[0] << 8) | (uint8_t)p[1];
+}
+
+//! skips the name at pos, which may end in a compression pointer. Returns false if it runs off the packet
+bool skipName(const char* packet, size_t len, size_t& pos)
+{
+  while(pos < len) {
+    uint8_t l = packet[pos];
+    if(!l) {
+      ++pos;
+      return true;
+    }
+    if((l & 0xc0) == 0xc0) {
+      pos += 2;
+      return pos <= len;
+    }
+    if(l & 0xc0)
+      return false;
+    pos += l + 1;
+  }
+  return false;
+}
+
+//! compares the name at pos, following compression pointers, with the uncompressed name at 'name'
+bool nameEquals(const char* packet, size_t len, size_t pos, const char* name)
+{
+  for(unsigned int jumps = 0; jumps < 16 && pos < len; ) {
+    uint8_t l = packet[pos];
+    if((l & 0xc0) == 0xc0) {
+      if(pos + 1 >= len)
+        return false;
+      pos = get16(packet + pos) & 0x3fff;
+      ++jumps;
+      continue;
+    }
+    if(l != (uint8_t)*name || pos + l >= len)
+      return false;
+    if(!l)
+      return true;
+    for(unsigned int n = 1; n <= l; ++n)
+      if(tolower((unsigned char)packet[pos + n]) != tolower((unsigned char)name[n]))
+        return false;
+    pos += l + 1;
+    name += l + 1;
+  }
+  return false;
+}
+}
+
+bool ResponseClassifier::classify(const char* packet, size_t len, uint32_t ip, ResponseInfo& info) const
+{
+  constexpr size_t headerSize = 12;
+  if(len < headerSize || !(packet[2] & 0x80)) // QR bit
+    return false;
+
+  info.id = get16(packet);
+  info.aa = packet[2] & 0x04;
+  info.tc = packet[2] & 0x02;
+  info.ra = packet[3] & 0x80;
+  info.rcode = packet[3] & 0x0f;
+  info.openResolver = false;
+
+  uint16_t qdcount = get16(packet + 4), ancount = get16(packet + 6);
+  info.hasQuestion = qdcount;
+  if(!qdcount)
+    return true;
+  if(qdcount != 1 || !d_tmpl.matchesQuestion(packet, len, info.id, ip))
+    return false;
+
+  size_t pos = headerSize + d_tmpl.questionSize();
+  for(uint16_t n = 0; n < ancount; ++n) {
+    size_t owner = pos;
+    if(!skipName(packet, len, pos) || pos + 10 > len)
+      return false;
+    uint16_t type = get16(packet + pos), rdlength = get16(packet + pos + 8);
+    pos += 10 + rdlength;
+    if(pos > len)
+      return false;
+    if(type == (uint16_t)DNSType::TXT && nameEquals(packet, len, owner, packet + headerSize)) {
+      info.openResolver = true;
+      break;
+    }
+  }
+  return true;
+}
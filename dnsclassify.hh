@@ -0,0 +1,34 @@
+#pragma once
+#include "dnsquery.hh"
+#include <cstddef>
+#include <cstdint>
+
+//! What we learn from a response, see ResponseClassifier
+struct ResponseInfo
+{
+  uint16_t id;
+  uint8_t rcode;
+  bool aa, tc, ra;
+  bool hasQuestion;  //<! some servers leave out the question, on REFUSED or FORMERR say
+  bool openResolver; //<! answered our TXT question, so it resolved it for us
+};
+
+/** Classifies responses to probes made with a QueryTemplate, working directly on the
+    received bytes without allocating anything.
+
+    The header is checked to be a response, and if there is a question it must be
+    exactly the one we sent to the responder, including IP label and case pattern. Then
+    the answer section is scanned for a TXT record for the question name.
+*/
+class ResponseClassifier
+{
+public:
+  explicit ResponseClassifier(const QueryTemplate& tmpl) : d_tmpl(tmpl)
+  {}
+
+  //! ip is the responder, in host byte order. Returns false for packets that are no valid response
+  bool classify(const char* packet, size_t len, uint32_t ip, ResponseInfo& info) const;
+
+private:
+  const QueryTemplate& d_tmpl;
+};
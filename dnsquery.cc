@@ -0,0 +1,69 @@
+#include "dnsquery.hh"
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+QueryTemplate::QueryTemplate(const std::string& qname, DNSType qtype, bool ipLabel, bool randomCase, uint64_t secret) :
+  d_qname(qname), d_secret(secret), d_ipLabel(ipLabel), d_randomCase(randomCase)
+{
+  DNSMessageWriter dmw(makeDNSName(ipLabel ? "00000000." + qname : qname), qtype);
+  dmw.dh.rd = true;
+  d_packet = dmw.serialize();
+
+  size_t pos = s_qnameOffset;
+  while(pos < d_packet.size() && d_packet[pos]) {
+    size_t len = (uint8_t)d_packet[pos];
+    for(size_t n = pos + 1; n <= pos + len && n < d_packet.size(); ++n)
+      if(isalpha((unsigned char)d_packet[n]))
+        d_letters.push_back(n);
+    pos += len + 1;
+  }
+  if(pos >= d_packet.size())
+    throw runtime_error("Could not find the qname in serialized query for "+qname);
+  if(d_packet.size() > s_maxSize)
+    throw runtime_error("Query for "+qname+" is too large");
+}
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+void QueryTemplate::write(char* buf, uint16_t id, uint32_t ip) const
+{
+  static const char hex[] = "0123456789abcdef";
+
+  memcpy(buf, d_packet.c_str(), d_packet.size());
+  buf[0] = id >> 8;
+  buf[1] = id & 0xff;
+  if(d_ipLabel) {
+    char* label = buf + s_ipLabelOffset;
+    for(int n = 0; n < 8; ++n)
+      label[n] = hex[(ip >> (28 - 4 * n)) & 0xf];
+  }
+  if(d_randomCase) {
+    uint64_t caseBits = mix(d_secret ^ (((uint64_t)ip << 16) | id));
+    unsigned int n = 0;
+    if(d_ipLabel) { // the hex label has its own letters, which the template has as '0'
+      for(int i = 0; i < 8; ++i, ++n)
+        if((caseBits >> (n & 63)) & 1)
+          buf[s_ipLabelOffset + i] = toupper((unsigned char)buf[s_ipLabelOffset + i]);
+    }
+    for(auto offset : d_letters)
+      if((caseBits >> (n++ & 63)) & 1)
+        buf[offset] ^= 0x20;
+  }
+}
+
+bool QueryTemplate::matchesQuestion(const char* packet, size_t len, uint16_t id, uint32_t ip) const
+{
+  if(len < d_packet.size())
+    return false;
+  char expected[s_maxSize];
+  write(expected, id, ip);
+  return !memcmp(packet + s_qnameOffset, expected + s_qnameOffset, questionSize());
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "dnsmessages.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** A DNS query that is serialized once, after which every probe gets its own copy with
+    the per-probe fields patched in place. Writing a probe allocates nothing.
+
+    Per probe, the ID is always set. Optionally, the qname gets a leading label with the
+    target IPv4 address in hex ('c0000201.whoami-ecs.lua.powerdns.org'), and the case of
+    the letters in the qname can be randomized ('dns 0x20'), which responders echo back.
+    The case pattern is a keyed hash of target and ID, so a response can be checked
+    against it without remembering anything per probe.
+*/
+class QueryTemplate
+{
+public:
+  QueryTemplate(const std::string& qname, DNSType qtype, bool ipLabel = false, bool randomCase = false, uint64_t secret = 0);
+
+  //! writes the probe to buf, which must have room for size() bytes. ip in host byte order
+  void write(char* buf, uint16_t id, uint32_t ip) const;
+
+  //! checks that the question section of a response is exactly what we asked 'ip'
+  bool matchesQuestion(const char* packet, size_t len, uint16_t id, uint32_t ip) const;
+
+  //! length of the qname plus qtype and qclass, which directly follows the header
+  size_t questionSize() const
+  {
+    return d_packet.size() - s_qnameOffset;
+  }
+
+  size_t size() const
+  {
+    return d_packet.size();
+  }
+
+  //! the labels of the qname, without the IP label
+  const std::string& qname() const
+  {
+    return d_qname;
+  }
+  bool hasIPLabel() const
+  {
+    return d_ipLabel;
+  }
+  bool hasRandomCase() const
+  {
+    return d_randomCase;
+  }
+
+private:
+  std::string d_packet;
+  std::string d_qname;
+  std::vector<uint16_t> d_letters; //<! offsets of the letters in the qname
+  uint64_t d_secret;
+  bool d_ipLabel, d_randomCase;
+  static constexpr size_t s_qnameOffset = 12, s_ipLabelOffset = 13; //<! after the header, length byte
+  static constexpr size_t s_maxSize = 512;
+};
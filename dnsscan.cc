@@ -1,4 +1,4 @@
-#include "sobseq.hh"
+#include "candidates.hh"
 #include <vector>
 #include <fstream>
 #include "netmask.hh"
@@ -6,118 +6,1484 @@
 #include "sclasses.hh"
 #include "record-types.hh"
 #include <thread>
+#include <atomic>
+#include <cstring>
 #include "common.hh"
+#include "ratelimit.hh"
+#include "batchio.hh"
+#include "dnsquery.hh"
+#include "probetable.hh"
+#include "dnsclassify.hh"
+#include "timerwheel.hh"
+#include "resultlog.hh"
+#include "stratify.hh"
+#include "estimate.hh"
+#include "eventloop.hh"
+#include "rawprobe.hh"
+#include "ipv6sample.hh"
+#include "stats.hh"
+#include "cacheline.hh"
+#include <deque>
+#include <unordered_set>
+#include <exception>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <getopt.h>
+#include <sys/resource.h>
 
 using namespace std;
 
-auto makeIPStr(double a, double b, double c, double d)
+/** Counters for one worker and its sockets. Workers sit next to each other in a vector,
+    so a cache line of padding at the end keeps them from sharing a line. */
+struct WorkerCounters
 {
-  ostringstream ipstream;
-  ipstream << ((int)(256*a)) << "." <<
-    ((int)(256*b)) << "." <<
-    ((int)(256*c)) << "." <<
-    ((int)(256*d));
-    
-  return ipstream.str();
+  std::atomic<uint32_t> sobmatches{0}, rndmatches{0};
+  std::atomic<uint32_t> sobresponses{0}, rndresponses{0};
+  std::atomic<uint32_t> openResolvers{0};
+  std::atomic<uint32_t> unsolicited{0}, duplicates{0}, late{0}, untracked{0}, parseErrors{0};
+  std::atomic<uint32_t> timeouts{0};
+  std::atomic<int64_t> outstanding{0}; //<! probes neither answered nor timed out yet
+  std::atomic<uint64_t> rttSum{0}; //<! ns, over all counted responses
+  std::atomic<uint64_t> syscalls{0}; //<! socket and epoll calls
+
+  // for --stats, only ever changed by the worker itself, see bump()
+  std::atomic<uint64_t> candidates{0}, rejected{0}; //<! addresses drawn, and those not announced
+  std::atomic<uint64_t> sent{0};
+  std::atomic<uint64_t> sendBlocked{0}; //<! batches a full socket buffer, or the kernel running out of buffers, stopped short
+  std::atomic<uint64_t> sendErrors{0};  //<! packets the kernel refused to send
+  std::atomic<uint64_t> rateLimited{0}; //<! times a batch had to wait for tokens
+  std::atomic<uint64_t> received{0};    //<! datagrams read, answers to our probes or not
+  std::atomic<uint64_t> pending{0}, queued{0}, timers{0}; //<! now: candidates not in a batch yet, packets in batches, probes waiting to time out
+  LatencyHistogram rtt;
+  CacheLinePad<> d_pad;
+};
+
+//! Per stratum and per method, for stratified scans
+struct StratumCounters
+{
+  std::atomic<uint32_t> probes[2], resolved[2], responses[2], openResolvers[2];
+};
+
+/** Outcomes per probe tag. Probes are resolved in bulk, once everything sent in the same
+    epoch is answered or has timed out, and only then do their answers count. Running
+    estimates only look at resolved probes: the probes still in flight would drag them
+    down, and answers that come in before the non-responses time out would push them up. */
+struct Tally
+{
+  std::atomic<uint32_t> resolved{0}, responses{0}, openResolvers{0};
+};
+
+//! Up to g_blocksize probes per method from one stratum, starting at point 'start' of its sequence
+struct WorkItem
+{
+  uint32_t stratum;
+  uint64_t start;
+  uint32_t count;
+};
+
+struct ScanOptions
+{
+  bool linearSobol{false};
+  uint64_t sobolSeed{0}, sobolStart{0};
+  unsigned int threads{1}; //<! workers, each with an event loop of its own
+  unsigned int sockets{2}; //<! per worker
+  uint32_t probes{100000};
+  double rate{2000}, burst{10}; //<! packets/s over all workers, 0 is unlimited
+  unsigned int batch{32}; //<! packets per sendmmsg()
+  bool ipLabel{false}, randomCase{false};
+  int64_t timeout{3000}; //<! ms after which an unanswered probe counts as a non-response
+  bool verbose{false}; //<! print every response in full
+  string resultsFile; //<! per-probe results log, gzipped if it ends in .gz
+  string excludeFile; //<! prefixes never to probe
+  string statsFile; //<! where to append a line of JSON with all counters, every statsInterval ms
+  unsigned int statsInterval{1000};
+  bool direct{false}; //<! map candidates into announced space instead of rejecting unannounced ones
+  string strata; //<! 'slash8', 'length' or a mapping file, empty for no stratification
+  bool neyman{false}; //<! allocate by stratum variance from a pilot, instead of by size
+  double pilot{0.2}; //<! fraction of probes for the Neyman pilot
+  double ciWidth{0}; //<! stop once 95% intervals are this narrow, in percentage points, 0 never
+  unsigned int replicates{1}; //<! independently scrambled Sobol sequences, for error estimates
+  bool raw{false}; //<! craft packets for a raw socket, with cookies instead of a probe table
+  uint32_t source{0}; //<! source address of raw packets
+  bool ipv6{false}; //<! probe announced IPv6 space instead
+  unsigned int v6Unit{48}; //<! prefix length of the units IPv6 space is sampled in
+  bool v6PerRange{false}; //<! every announced range equally likely, instead of every unit
+  unsigned int v6IIDBits{8}; //<! random low bits of the interface identifier
+  string v6Hitlist; //<! addresses to copy the bits below the unit from
+};
+
+/* The low bit of a probe tag is the method, the rest is the Sobol replicate. Random
+   probes are always replicate 0. */
+enum ProbeTag : uint8_t { SobolProbe = 0, RandomProbe = 1 };
+constexpr unsigned int g_maxReplicates = 64;
+
+uint8_t sobolTag(unsigned int replicate)
+{
+  return replicate << 1 | SobolProbe;
 }
 
-auto makeDNSQuery(const std::string& name)
+//! replicate r is scrambled with its own seed, a single replicate just uses --sobol-seed
+uint64_t replicateSeed(const ScanOptions& opts, unsigned int replicate)
 {
-  DNSName dn = makeDNSName(name);
-  DNSType dt = DNSType::TXT;
-  DNSMessageWriter dmw(dn, dt);
-          
-  dmw.dh.rd = true;
-  dmw.randomizeID();
-  return dmw.serialize();
+  return opts.replicates > 1 ? (opts.sobolSeed << 8) + replicate + 1 : opts.sobolSeed;
 }
 
-uint32_t g_openResolvers;
-void listenerThread(int s, unsigned int* counter, string name)
+//! What all workers share
+struct ScanContext
 {
-  ComboAddress dest("0.0.0.0");
-  for(;;) {
-    auto resp=SRecvfrom(s, 1500, dest);
-    try {
-      DNSMessageReader dmr(resp);
-      DNSSection rrsection;
-      uint32_t ttl;
-      
-      cout<<name<<" response from "<<dest.toStringWithPort() <<", "<<(RCode)dmr.dh.rcode<<endl;
-      std::unique_ptr<RRGen> rr;
-      DNSName dn;
-      DNSType dt;
-      while(dmr.getRR(rrsection, dn, dt, ttl, rr)) {
-        cout << " "<<dn<< " IN " << dt << " " << ttl << " " <<rr->toString()<<endl;
-        if(dn == DNSName({"whoami-ecs", "lua", "powerdns", "org"}) && dt == DNSType::TXT) {
-          ++g_openResolvers;
-          break;
+  ScanContext(const ScanOptions& o, IPv4Table&& t) :
+    opts(o), table(std::move(t)),
+    tmpl("whoami-ecs.lua.powerdns.org", DNSType::TXT, opts.ipLabel, opts.randomCase, (uint64_t)std::random_device{}() << 32 | std::random_device{}()),
+    limiter(opts.rate, opts.burst),
+    probes(opts.raw ? 0 : 4 * (size_t)opts.probes), // every probe of the scan keeps its slot, raw scans keep no state per probe
+    counters(opts.threads),
+    tallies(new Tally[2 * opts.replicates]),
+    failures(opts.threads)
+  {
+    for(unsigned int n = 0; n < 2 * opts.replicates; ++n)
+      tagNames.push_back(n & RandomProbe ? "rnd" : (opts.replicates > 1 ? "sob" + to_string(n >> 1) : "sob"));
+    for(const auto& name : tagNames)
+      tagPtrs.push_back(name.c_str());
+    if(opts.direct) {
+      announced = PrefixSet(table);
+      if(announced.empty())
+        throw runtime_error("No announced addresses to scan");
+    }
+    if(!opts.resultsFile.empty())
+      results.reset(new ResultLog(opts.resultsFile, tagPtrs.data()));
+    if(opts.raw) {
+      cookie.reset(new ProbeCookie((uint64_t)std::random_device{}() << 32 | std::random_device{}(), opts.threads));
+    }
+  }
+
+  const ScanOptions opts;
+  const IPv4Table table;
+  PrefixSet announced; //<! only with opts.direct
+  std::unique_ptr<IPv6Sampler> sampler6; //<! only with opts.ipv6
+  std::unique_ptr<Strata> strata; //<! only for stratified scans
+  std::unique_ptr<StratumCounters[]> stratumCounters;
+  vector<WorkItem> plan; //<! what the workers of a stratified scan are to send
+  const QueryTemplate tmpl;
+  TokenBucket limiter;
+  ProbeTable probes;
+  vector<WorkerCounters> counters;
+  std::unique_ptr<Tally[]> tallies; //<! indexed by probe tag
+  vector<string> tagNames;
+  vector<const char*> tagPtrs;
+  std::unique_ptr<ResultLog> results;
+  std::unique_ptr<ProbeCookie> cookie; //<! only for raw scans
+  std::atomic<uint32_t> totalmatches{0};
+  std::atomic<bool> stopSending{false}; //<! the estimates are good enough, or a worker failed
+  vector<std::exception_ptr> failures; //<! per worker, rethrown from main once all are done
+};
+
+
+// candidates are generated and filtered a block at a time
+constexpr unsigned int g_blocksize = 1024;
+
+/* With --direct, a 32-bit point u is scaled to k in [0, announced addresses) and
+   becomes the k-th announced address, so nothing gets thrown away. Sobol points
+   keep their spacing this way, just over announced space instead of all of it. */
+void mapToAnnounced(const PrefixSet& announced, uint32_t* ips, size_t n)
+{
+  uint64_t count = announced.addressCount();
+  for(size_t i = 0; i < n; ++i)
+    ips[i] = announced.at(((uint64_t)ips[i] * count) >> 32);
+}
+
+// from a 64-bit draw, so every address is equally likely
+uint32_t randomIn(const PrefixSet& space, std::mt19937_64& gen)
+{
+  return space.at(((unsigned __int128)gen() * space.addressCount()) >> 64);
+}
+
+ComboAddress makeComboAddress6(IPv6Address ip, uint16_t port)
+{
+  ComboAddress ret;
+  memset(&ret.sin6, 0, sizeof(ret.sin6));
+  ret.sin6.sin6_family = AF_INET6;
+  for(int n = 15; n >= 0; --n, ip >>= 8)
+    ret.sin6.sin6_addr.s6_addr[n] = ip & 0xff;
+  ret.sin6.sin6_port = htons(port);
+  return ret;
+}
+
+/* The probe table, the query template and the classifier know targets by a 32-bit
+   number. For IPv4 that is the address, an IPv6 address is hashed down to one. */
+bool addressKey(const ComboAddress& addr, uint32_t& key)
+{
+  if(addr.sin4.sin_family == AF_INET) {
+    key = ntohl(addr.sin4.sin_addr.s_addr);
+    return true;
+  }
+  if(addr.sin4.sin_family != AF_INET6)
+    return false;
+  uint64_t hi, lo;
+  memcpy(&hi, addr.sin6.sin6_addr.s6_addr, 8);
+  memcpy(&lo, addr.sin6.sin6_addr.s6_addr + 8, 8);
+  key = ((hi * 0x9e3779b97f4a7c15ULL) ^ lo) * 0xbf58476d1ce4e5b9ULL >> 32;
+  return true;
+}
+
+/** Sends a share of the probes, receives the answers on its own sockets and times out the
+    probes that go unanswered, all from one event loop on one thread. Nothing blocks:
+    waiting for tokens or for room in a socket buffer goes through the loop, so receiving
+    never stalls behind sending, or the other way around.
+
+    Worker number 'id' of 'threads' takes every threads'th block of the Sobol sequence,
+    so together the workers cover the same blocks a single one would. Where each stops
+    in its last block once the probe budget is used up depends on timing.
+
+    Probes count as resolved in bulk, once everything sent in the same epoch of a quarter
+    of the timeout has timed out. Answers wait with their epoch until then, and go into
+    the estimates together with their probes.
+
+    A raw scan sends crafted packets, and reads every UDP packet that comes in from a raw
+    socket of its own. Answers are checked against their cookie instead of the probe
+    table. The epoch is in the ID, and answers to an epoch that has already timed out
+    are late.
+*/
+class ScanWorker
+{
+public:
+  //! rawReceiver is a raw UDP socket for raw scans, -1 otherwise
+  ScanWorker(ScanContext* ctx, unsigned int id, uint32_t seed, const vector<int>& sockets, int rawReceiver);
+  ScanWorker(const ScanWorker&) = delete;
+
+  //! returns once everything is sent, and answered or timed out
+  void run();
+
+private:
+  struct Candidate
+  {
+    uint32_t ip;
+    uint8_t tag;
+    IPv6Address ip6; //<! for IPv6 scans, instead of ip
+  };
+  // probes that are not answered within the timeout count as non-responses
+  struct Probe
+  {
+    uint32_t ip;
+    uint16_t id;
+    uint8_t tag;
+  };
+  //! probes of a raw scan with the same tag and stratum, and the answers to them so far
+  struct Sent
+  {
+    uint32_t count, responses, openResolvers;
+  };
+  //! probes sent in the same epoch, which resolve together
+  struct Epoch
+  {
+    uint64_t number;
+    int64_t deadline;
+    vector<Sent> sent; //<! by sentIndex()
+    std::unordered_set<uint32_t> answered; //<! cookie slots, so a raw scan counts every answer once
+  };
+  //! a socket, and the batch that goes out through it
+  struct Outlet
+  {
+    Outlet(int s, unsigned int batchsize) : sock(s), batch(s, batchsize), receiver(s), tags(batchsize) {}
+    int sock;
+    UDPBatchSender batch;
+    UDPBatchReceiver receiver;
+    vector<uint8_t> tags; //<! of the packets in batch
+    uint64_t epoch{0}; //<! of the packets in batch, which raw scans also put in their IDs
+    bool paid{false}; //<! the batch has its tokens and is in the probe table, it only needs to go out
+    bool writable{true};
+  };
+
+  bool generate();
+  bool haveCandidate();
+  int64_t send(int64_t now);
+  void track(Outlet& o, int64_t now);
+  void untrack(const Outlet& o, unsigned int n);
+  void receive(Outlet& o);
+  void receiveRaw();
+  void handleResponse(const char* data, size_t len, const ComboAddress& from, int64_t now);
+  void handleRaw(const char* packet, size_t len, int64_t now);
+  void score(const char* data, size_t len, const ResponseInfo& info, ProbeResult& result, int64_t rtt, const ComboAddress& from, int stratum, Sent* pending = nullptr);
+  void expire(const Probe& p);
+  void expireSent(int64_t now);
+  size_t sentIndex(uint8_t tag, int stratum) const
+  {
+    return (stratum + 1) * 2 * d_opts.replicates + tag;
+  }
+  Epoch* findEpoch(uint64_t number);
+  void publish();
+
+  static constexpr unsigned int s_maxBatches = 8; //<! per socket and turn, so no socket starves the others
+
+  ScanContext* d_ctx;
+  const ScanOptions& d_opts;
+  unsigned int d_id;
+  WorkerCounters* d_wc;
+  ResponseClassifier d_classifier;
+  EventLoop d_loop;
+  vector<std::unique_ptr<Outlet>> d_outlets;
+  unsigned int d_turn{0}; //<! the outlet to send through next
+  int64_t d_sendAt{0}; //<! when to try sending again
+  uint64_t d_syscalls{0}; //<! as far as publish() counted them
+  TimerWheel<Probe> d_timeouts;
+  std::unique_ptr<UDPBatchReceiver> d_rawReceiver;
+  const int64_t d_epochLength; //<! ns
+  std::deque<Epoch> d_epochs; //<! in order of deadline
+
+  vector<SobolIPv4Generator> d_sobgens;
+  vector<LinearSobolIPv4Generator> d_linsobgens;
+  RandomIPv4Generator d_rndgen;
+  std::mt19937_64 d_directgen; // 64 bits, so every announced address is equally likely
+  std::mt19937 d_idgen;
+  size_t d_item; //<! next work item of a stratified scan
+  uint64_t d_block; //<! next block of an unstratified scan
+  bool d_exhausted{false};
+  vector<Candidate> d_pending; //<! candidates of the current block
+  size_t d_next{0};
+  uint32_t d_sobips[g_blocksize], d_rndips[g_blocksize];
+  uint8_t d_sobannounced[g_blocksize], d_rndannounced[g_blocksize];
+};
+
+ScanWorker::ScanWorker(ScanContext* ctx, unsigned int id, uint32_t seed, const vector<int>& sockets, int rawReceiver) :
+  d_ctx(ctx), d_opts(ctx->opts), d_id(id), d_wc(&ctx->counters[id]), d_classifier(ctx->tmpl),
+  d_timeouts(1000000, monotonicNs()), d_epochLength(std::max<int64_t>(1000000, d_opts.timeout * 1000000 / 4)), d_rndgen(seed), d_directgen(seed), d_idgen(seed), d_item(id), d_block(id)
+{
+  for(unsigned int r = 0; r < d_opts.replicates; ++r) {
+    d_sobgens.emplace_back(replicateSeed(d_opts, r));
+    d_linsobgens.emplace_back(replicateSeed(d_opts, r));
+  }
+  d_pending.reserve(2 * g_blocksize);
+  for(int s : sockets) {
+    d_outlets.emplace_back(new Outlet(s, d_opts.batch));
+    Outlet* o = d_outlets.back().get();
+    d_loop.add(s, EPOLLIN, [this, o](uint32_t events) {
+        if(events & EPOLLOUT) {
+          o->writable = true;
+          d_sendAt = 0;
+          d_loop.modify(o->sock, EPOLLIN);
+        }
+        if(events & (EPOLLIN | EPOLLERR))
+          receive(*o);
+      });
+  }
+  if(rawReceiver >= 0) {
+    d_rawReceiver.reset(new UDPBatchReceiver(rawReceiver));
+    d_loop.add(rawReceiver, EPOLLIN, [this](uint32_t) { receiveRaw(); });
+  }
+}
+
+//! the next block of candidates, false once there are no more
+bool ScanWorker::generate()
+{
+  d_pending.clear();
+  d_next = 0;
+  if(d_ctx->stopSending)
+    return false;
+
+  // a stratified scan just works through its plan, from the stratum's own sequences
+  if(d_ctx->strata) {
+    if(d_item >= d_ctx->plan.size())
+      return false;
+    const WorkItem& w = d_ctx->plan[d_item];
+    d_item += d_opts.threads;
+    const PrefixSet& space = (*d_ctx->strata)[w.stratum].space;
+    d_linsobgens[0].seek(d_opts.sobolStart + w.start);
+    d_linsobgens[0].fill(d_sobips, w.count);
+    mapToAnnounced(space, d_sobips, w.count);
+    for(unsigned int pos = 0; pos < w.count; ++pos) {
+      d_pending.push_back({d_sobips[pos], SobolProbe, 0});
+      d_pending.push_back({randomIn(space, d_directgen), RandomProbe, 0});
+    }
+    d_wc->sobmatches += w.count;
+    d_wc->rndmatches += w.count;
+    bump(d_wc->candidates, 2 * w.count);
+    d_ctx->totalmatches += 2 * w.count;
+    d_ctx->stratumCounters[w.stratum].probes[SobolProbe] += w.count;
+    d_ctx->stratumCounters[w.stratum].probes[RandomProbe] += w.count;
+    return true;
+  }
+
+  /* with replicates, block b goes to replicate b % replicates, and each replicate works
+     through its own sequence */
+  if(d_ctx->totalmatches >= d_opts.probes)
+    return false;
+  uint64_t block = d_block;
+  d_block += d_opts.threads;
+  unsigned int replicate = block % d_opts.replicates;
+  uint64_t index = d_opts.sobolStart + (block / d_opts.replicates) * g_blocksize;
+  if(d_opts.linearSobol) {
+    d_linsobgens[replicate].seek(index);
+    d_linsobgens[replicate].fill(d_sobips, g_blocksize);
+  }
+  else {
+    d_sobgens[replicate].seek(index);
+    d_sobgens[replicate].fill(d_sobips, g_blocksize);
+  }
+  uint8_t sobtag = sobolTag(replicate);
+  // a Sobol point picks the IPv6 unit, which is where the space is evenly spread
+  if(d_ctx->sampler6) {
+    for(unsigned int pos = 0; pos < g_blocksize && d_ctx->totalmatches < d_opts.probes; ++pos) {
+      d_pending.push_back({0, sobtag, d_ctx->sampler6->pick((uint64_t)d_sobips[pos] << 32 | (uint32_t)d_directgen(), d_directgen)});
+      d_pending.push_back({0, RandomProbe, d_ctx->sampler6->pick(d_directgen(), d_directgen)});
+      ++d_wc->sobmatches;
+      ++d_wc->rndmatches;
+      d_ctx->totalmatches += 2;
+      bump(d_wc->candidates, 2);
+    }
+    return true;
+  }
+  if(d_opts.direct) {
+    mapToAnnounced(d_ctx->announced, d_sobips, g_blocksize);
+    for(auto& ip : d_rndips)
+      ip = randomIn(d_ctx->announced, d_directgen);
+    memset(d_sobannounced, 1, sizeof(d_sobannounced));
+    memset(d_rndannounced, 1, sizeof(d_rndannounced));
+  }
+  else {
+    d_rndgen.fill(d_rndips, g_blocksize);
+    d_ctx->table.matchBatch(d_sobips, g_blocksize, d_sobannounced);
+    d_ctx->table.matchBatch(d_rndips, g_blocksize, d_rndannounced);
+  }
+
+  unsigned int pos = 0, matched = d_pending.size();
+  for(; pos < g_blocksize && d_ctx->totalmatches < d_opts.probes; ++pos) {
+    if(d_sobannounced[pos]) {
+      ++d_wc->sobmatches;
+      ++d_ctx->totalmatches;
+      d_pending.push_back({d_sobips[pos], sobtag, 0});
+    }
+    if(d_rndannounced[pos]) {
+      ++d_wc->rndmatches;
+      ++d_ctx->totalmatches;
+      d_pending.push_back({d_rndips[pos], RandomProbe, 0});
+    }
+  }
+  bump(d_wc->candidates, 2 * pos);
+  bump(d_wc->rejected, 2 * pos - (d_pending.size() - matched));
+  return true;
+}
+
+bool ScanWorker::haveCandidate()
+{
+  if(d_ctx->stopSending) {
+    d_pending.clear();
+    d_next = 0;
+    d_exhausted = true;
+  }
+  while(d_next == d_pending.size() && !d_exhausted)
+    d_exhausted = !generate();
+  return d_next < d_pending.size();
+}
+
+/* Fills a batch, waits for the tokens to send all of it, and puts its probes in the
+   probe table just before they go out. Returns when to send again: now if it only
+   stopped so the loop gets to receive, when the next tokens come in, or never if all
+   sockets are full or there is nothing left, as EPOLLOUT calls us back in the first case. */
+int64_t ScanWorker::send(int64_t now)
+{
+  for(unsigned int sent = 0; sent < s_maxBatches * d_outlets.size(); ++sent) {
+    Outlet* o = nullptr;
+    for(size_t n = 0; n < d_outlets.size() && !o; ++n) {
+      if(d_outlets[d_turn]->writable)
+        o = d_outlets[d_turn].get();
+      else
+        d_turn = (d_turn + 1) % d_outlets.size();
+    }
+    if(!o)
+      return INT64_MAX;
+
+    if(!o->paid) {
+      while(!o->batch.full() && haveCandidate()) {
+        const Candidate& c = d_pending[d_next++];
+        o->tags[o->batch.queued()] = c.tag;
+        // the probe goes straight into the batch, with a fresh ID or its cookie
+        if(d_ctx->cookie) {
+          if(!o->batch.queued())
+            o->epoch = now / d_epochLength;
+          auto cookie = d_ctx->cookie->make(c.ip, c.tag, d_id, o->epoch);
+          char* packet = o->batch.buffer();
+          d_ctx->tmpl.write(packet + g_udpHeaders, cookie.id, c.ip);
+          writeUDPHeaders(packet, d_opts.source, c.ip, cookie.port, 53, d_ctx->tmpl.size());
+          o->batch.add(g_udpHeaders + d_ctx->tmpl.size(), makeComboAddress(c.ip, 0));
+        }
+        else {
+          ComboAddress dest = d_ctx->sampler6 ? makeComboAddress6(c.ip6, 53) : makeComboAddress(c.ip, 53);
+          uint32_t key;
+          addressKey(dest, key);
+          d_ctx->tmpl.write(o->batch.buffer(), (uint16_t)d_idgen(), key);
+          o->batch.add(d_ctx->tmpl.size(), dest);
         }
       }
-      
-      (*counter)++;
+      if(!o->batch.queued())
+        return INT64_MAX;
+      if(!d_ctx->limiter.tryTake(o->batch.queued())) {
+        bump(d_wc->rateLimited);
+        return d_ctx->limiter.nextAvailable(o->batch.queued());
+      }
+      track(*o, now);
+      o->paid = true;
+    }
+
+    uint64_t errors = o->batch.errors();
+    unsigned int done = o->batch.flush([this, o](unsigned int n) { untrack(*o, n); });
+    bump(d_wc->sendErrors, o->batch.errors() - errors);
+    bump(d_wc->sent, done - (o->batch.errors() - errors));
+    // the batch moved what is left to the front, its tags go along
+    std::copy(o->tags.begin() + done, o->tags.begin() + done + o->batch.queued(), o->tags.begin());
+    if(o->batch.queued() && o->batch.congested()) { // nothing says when buffers free up again, so back off a little
+      bump(d_wc->sendBlocked);
+      return now + 1000000;
+    }
+    if(o->batch.queued()) { // the socket buffer is full, the rest goes once there is room
+      bump(d_wc->sendBlocked);
+      o->writable = false;
+      d_loop.modify(o->sock, EPOLLIN | EPOLLOUT);
+    }
+    else
+      o->paid = false;
+    d_turn = (d_turn + 1) % d_outlets.size();
+  }
+  return now;
+}
+
+ScanWorker::Epoch* ScanWorker::findEpoch(uint64_t number)
+{
+  for(auto iter = d_epochs.rbegin(); iter != d_epochs.rend(); ++iter)
+    if(iter->number == number)
+      return &*iter;
+  return nullptr;
+}
+
+//! counts the probes in a batch that is about to go out with their epoch, and puts them in the probe table unless they are raw
+void ScanWorker::track(Outlet& o, int64_t now)
+{
+  int64_t deadline = now + d_opts.timeout * 1000000;
+  // a raw batch that waited for tokens may have been filled in the epoch before
+  if(!d_ctx->cookie)
+    o.epoch = now / d_epochLength;
+  Epoch* epoch = findEpoch(o.epoch);
+  if(!epoch) {
+    size_t strata = d_ctx->strata ? d_ctx->strata->size() : 0;
+    d_epochs.push_back({o.epoch, (int64_t)(o.epoch + 1) * d_epochLength + d_opts.timeout * 1000000, vector<Sent>(sentIndex(0, strata))});
+    epoch = &d_epochs.back();
+  }
+  for(unsigned int n = 0; n < o.batch.queued(); ++n) {
+    uint32_t ip = 0;
+    addressKey(o.batch.dest(n), ip);
+    Sent& sent = epoch->sent[sentIndex(o.tags[n], d_ctx->strata ? d_ctx->strata->find(ip) : -1)];
+    if(d_ctx->cookie) {
+      ++sent.count;
+      continue;
     }
-    catch(std::exception& e) {
-      cout<<"Error parsing DNS response from "<<dest.toString()<<": "<<e.what()<<endl;
+    const char* packet = o.batch.packet(n);
+    Probe p{ip, (uint16_t)(((uint8_t)packet[0] << 8) | (uint8_t)packet[1]), o.tags[n]};
+    if(d_ctx->probes.insert(p.ip, p.id, now, p.tag)) {
+      ++sent.count;
+      ++d_wc->outstanding;
+      d_timeouts.add(deadline, p);
     }
-      
+    else
+      ++d_wc->untracked;
+  }
+}
+
+//! takes back packet n of a batch, which the kernel refused to send, so it doesn't count as unanswered
+void ScanWorker::untrack(const Outlet& o, unsigned int n)
+{
+  uint32_t ip = 0;
+  addressKey(o.batch.dest(n), ip);
+  if(!d_ctx->cookie) {
+    const char* packet = o.batch.packet(n);
+    if(!d_ctx->probes.expire(ip, ((uint8_t)packet[0] << 8) | (uint8_t)packet[1]))
+      return; // it was not in the probe table, and counted as untracked
+    --d_wc->outstanding;
   }
+  // the timeout is far longer than a socket buffer stays full, so the epoch is still here
+  if(Epoch* epoch = findEpoch(o.epoch))
+    --epoch->sent[sentIndex(o.tags[n], d_ctx->strata ? d_ctx->strata->find(ip) : -1)].count;
+}
+
+void ScanWorker::receive(Outlet& o)
+{
+  for(unsigned int round = 0; round < s_maxBatches; ++round) {
+    unsigned int num = o.receiver.receive(MSG_DONTWAIT);
+    if(!num)
+      return;
+    bump(d_wc->received, num);
+    int64_t now = monotonicNs();
+    for(unsigned int n = 0; n < num; ++n)
+      handleResponse(o.receiver.data(n), o.receiver.size(n), o.receiver.from(n), now);
+  }
+}
+
+void ScanWorker::handleResponse(const char* data, size_t len, const ComboAddress& dest, int64_t now)
+{
+  WorkerCounters* wc = d_wc;
+  ScanContext* ctx = d_ctx;
+  ProbeResult result{now, 0, 0, 0, ProbeResult::NoTag, ProbeResult::Unsolicited, 0, 0};
+  bool known = addressKey(dest, result.ip);
+  auto log = [&ctx, &result](ProbeResult::Kind kind) {
+    result.kind = kind;
+    if(ctx->results)
+      ctx->results->log(result);
+  };
+
+  // only the first answer from the address we probed, with the ID we sent, counts
+  if(len < 12 || !known || ntohs(dest.sin4.sin_port) != 53) {
+    ++wc->unsolicited;
+    log(ProbeResult::Unsolicited);
+    return;
+  }
+  int64_t rtt;
+  result.id = ((uint8_t)data[0] << 8) | (uint8_t)data[1];
+  // a packet that does not check out leaves the probe waiting for the real answer
+  ResponseInfo info;
+  auto answer = ctx->probes.peek(result.ip, result.id, &result.tag);
+  if(answer == ProbeTable::Answer::First) {
+    if(!d_classifier.classify(data, len, result.ip, info)) {
+      ++wc->parseErrors;
+      log(ProbeResult::Malformed);
+      return;
+    }
+    answer = ctx->probes.answer(result.ip, result.id, now, &rtt, &result.tag);
+  }
+  if(answer == ProbeTable::Answer::Unsolicited) {
+    ++wc->unsolicited;
+    log(ProbeResult::Unsolicited);
+    return;
+  }
+  if(answer == ProbeTable::Answer::Duplicate) {
+    ++wc->duplicates;
+    log(ProbeResult::Duplicate);
+    return;
+  }
+  if(answer == ProbeTable::Answer::Late) {
+    ++wc->late;
+    log(ProbeResult::Late);
+    return;
+  }
+  --wc->outstanding;
+  int stratum = ctx->strata ? ctx->strata->find(result.ip) : -1;
+  // the epoch outlives the timeouts of its probes, give or take a tick of the timer wheel
+  Epoch* epoch = findEpoch((now - rtt) / d_epochLength);
+  score(data, len, info, result, rtt, dest, stratum, epoch ? &epoch->sent[sentIndex(result.tag, stratum)] : nullptr);
+}
+
+void ScanWorker::receiveRaw()
+{
+  for(unsigned int round = 0; round < s_maxBatches; ++round) {
+    unsigned int num = d_rawReceiver->receive(MSG_DONTWAIT);
+    if(!num)
+      return;
+    bump(d_wc->received, num);
+    int64_t now = monotonicNs();
+    for(unsigned int n = 0; n < num; ++n)
+      handleRaw(d_rawReceiver->data(n), d_rawReceiver->size(n), now);
+  }
+}
+
+/* The raw socket sees all UDP that comes in, so anything that is not from port 53 to
+   the address and a port we send from is left alone */
+void ScanWorker::handleRaw(const char* packet, size_t len, int64_t now)
+{
+  UDPPacket udp;
+  if(!parseUDPPacket(packet, len, udp) || udp.dst != d_opts.source || udp.sport != 53 || d_ctx->cookie->worker(udp.dport) != (int)d_id)
+    return;
+  ProbeResult result{now, udp.src, 0, 0, ProbeResult::NoTag, ProbeResult::Unsolicited, 0, 0};
+  auto log = [this, &result](ProbeResult::Kind kind) {
+    result.kind = kind;
+    if(d_ctx->results)
+      d_ctx->results->log(result);
+  };
+  if(udp.len < 12) {
+    ++d_wc->unsolicited;
+    log(ProbeResult::Unsolicited);
+    return;
+  }
+  result.id = ((uint8_t)udp.payload[0] << 8) | (uint8_t)udp.payload[1];
+  // the tag is not in the packet, but there are only a few to try
+  ProbeCookie::Value cookie;
+  for(unsigned int tag = 0; tag < 2 * d_opts.replicates; ++tag) {
+    cookie = d_ctx->cookie->make(udp.src, tag, d_id);
+    if(cookie.port == udp.dport && cookie.id == (result.id & ~ProbeCookie::s_epochMask)) {
+      result.tag = tag;
+      break;
+    }
+  }
+  if(result.tag == ProbeResult::NoTag) {
+    ++d_wc->unsolicited;
+    log(ProbeResult::Unsolicited);
+    return;
+  }
+  // the latest epoch with these low bits, as an answer in time is never more than a few epochs old
+  uint64_t current = now / d_epochLength;
+  uint64_t number = current - ((current - (result.id & ProbeCookie::s_epochMask)) & ProbeCookie::s_epochMask);
+  Epoch* epoch = findEpoch(number);
+  if(!epoch) {
+    ++d_wc->late;
+    log(ProbeResult::Late);
+    return;
+  }
+  // a packet that does not check out leaves room for the real answer
+  ResponseInfo info;
+  if(!d_classifier.classify(udp.payload, udp.len, udp.src, info)) {
+    ++d_wc->parseErrors;
+    log(ProbeResult::Malformed);
+    return;
+  }
+  if(!epoch->answered.insert(cookie.slot).second) {
+    ++d_wc->duplicates;
+    log(ProbeResult::Duplicate);
+    return;
+  }
+  int stratum = d_ctx->strata ? d_ctx->strata->find(udp.src) : -1;
+  score(udp.payload, udp.len, info, result, 0, makeComboAddress(udp.src, 53), stratum, &epoch->sent[sentIndex(result.tag, stratum)]);
+}
+
+/* Counts and logs a classified answer to one of our probes, rtt is 0 for raw scans. Answers
+   go to the estimates once their probes resolve, until then they wait in 'pending'. Without
+   it the probe is resolved already, and only the answer still has to be counted. */
+void ScanWorker::score(const char* data, size_t len, const ResponseInfo& info, ProbeResult& result, int64_t rtt, const ComboAddress& dest, int stratum, Sent* pending)
+{
+  WorkerCounters* wc = d_wc;
+  ScanContext* ctx = d_ctx;
+  auto log = [&ctx, &result](ProbeResult::Kind kind) {
+    result.kind = kind;
+    if(ctx->results)
+      ctx->results->log(result);
+  };
+  Tally& tally = ctx->tallies[result.tag];
+
+  ++((result.tag & RandomProbe) ? wc->rndresponses : wc->sobresponses);
+  if(info.openResolver)
+    ++wc->openResolvers;
+  if(pending) {
+    ++pending->responses;
+    if(info.openResolver)
+      ++pending->openResolvers;
+  }
+  else {
+    ++tally.responses;
+    if(info.openResolver)
+      ++tally.openResolvers;
+    if(stratum >= 0) {
+      ++ctx->stratumCounters[stratum].responses[result.tag & RandomProbe];
+      if(info.openResolver)
+        ++ctx->stratumCounters[stratum].openResolvers[result.tag & RandomProbe];
+    }
+  }
+  wc->rttSum += rtt;
+  if(!ctx->cookie)
+    wc->rtt.record(rtt);
+
+  result.rtt = rtt / 1000;
+  result.rcode = info.rcode;
+  result.flags = (info.aa ? ProbeResult::AA : 0) | (info.tc ? ProbeResult::TC : 0) |
+    (info.ra ? ProbeResult::RA : 0) | (info.openResolver ? ProbeResult::OpenResolver : 0);
+  log(ProbeResult::Response);
+
+  if(!ctx->opts.verbose)
+    return;
+  try {
+    DNSMessageReader dmr(data, len);
+    DNSSection rrsection;
+    uint32_t ttl;
+
+    cout<<ctx->tagNames[result.tag]<<" response from "<<dest.toStringWithPort() <<", "<<(RCode)dmr.dh.rcode;
+    if(!ctx->cookie)
+      cout<<", "<<rtt/1000000.0<<" ms";
+    cout<<endl;
+    std::unique_ptr<RRGen> rr;
+    DNSName dn;
+    DNSType dt;
+    while(dmr.getRR(rrsection, dn, dt, ttl, rr))
+      cout << " "<<dn<< " IN " << dt << " " << ttl << " " <<rr->toString()<<endl;
+  }
+  catch(std::exception& e) {
+    cout<<"Error parsing DNS response from "<<dest.toString()<<": "<<e.what()<<endl;
+  }
+}
+
+void ScanWorker::expire(const Probe& p)
+{
+  if(d_ctx->probes.expire(p.ip, p.id)) {
+    ++d_wc->timeouts;
+    --d_wc->outstanding;
+    if(d_ctx->results)
+      d_ctx->results->log({monotonicNs(), p.ip, 0, p.id, p.tag, ProbeResult::Timeout, 0, 0});
+  }
+}
+
+//! probes of the epochs that are due now count as resolved, and their answers as responses
+void ScanWorker::expireSent(int64_t now)
+{
+  unsigned int tags = 2 * d_opts.replicates;
+  while(!d_epochs.empty() && d_epochs.front().deadline <= now) {
+    const auto& sent = d_epochs.front().sent;
+    for(size_t n = 0; n < sent.size(); ++n) {
+      const Sent& s = sent[n];
+      if(!s.count)
+        continue;
+      uint8_t tag = n % tags;
+      int stratum = n / tags - 1;
+      if(d_ctx->cookie)
+        d_wc->timeouts += s.count; // less the answers, which we can only subtract at the end
+      Tally& tally = d_ctx->tallies[tag];
+      tally.resolved += s.count;
+      tally.responses += s.responses;
+      tally.openResolvers += s.openResolvers;
+      if(stratum >= 0) {
+        auto& sc = d_ctx->stratumCounters[stratum];
+        sc.resolved[tag & RandomProbe] += s.count;
+        sc.responses[tag & RandomProbe] += s.responses;
+        sc.openResolvers[tag & RandomProbe] += s.openResolvers;
+      }
+    }
+    d_epochs.pop_front();
+  }
+}
+
+void ScanWorker::run()
+{
+  for(;;) {
+    int64_t now = monotonicNs();
+    if(d_sendAt <= now)
+      d_sendAt = send(now);
+    d_timeouts.advance(now, [this](const Probe& p) { expire(p); });
+    expireSent(now);
+
+    bool sending = !d_exhausted || d_next < d_pending.size();
+    for(const auto& o : d_outlets)
+      sending |= o->batch.queued() > 0;
+    // done once everything is answered, or the last probe timed out
+    if(!sending && (d_ctx->cookie ? d_epochs.empty() : d_wc->outstanding <= 0 || d_timeouts.empty())) {
+      expireSent(INT64_MAX);
+      break;
+    }
+
+    // wake up for the next send slot and timer tick, and every now and then to check whether to stop
+    int64_t deadline = std::min(d_sendAt, now + 100000000);
+    if(!d_timeouts.empty())
+      deadline = std::min(deadline, now + 1000000);
+    if(!d_epochs.empty())
+      deadline = std::min(deadline, d_epochs.front().deadline);
+    publish();
+    d_loop.poll(deadline);
+  }
+  publish();
+}
+
+//! brings the queue depths and syscall count in the counters up to date
+void ScanWorker::publish()
+{
+  uint64_t syscalls = d_loop.syscalls() + (d_rawReceiver ? d_rawReceiver->syscalls() : 0), queued = 0;
+  for(const auto& o : d_outlets) {
+    syscalls += o->batch.syscalls() + o->receiver.syscalls();
+    queued += o->batch.queued();
+  }
+  bump(d_wc->syscalls, syscalls - d_syscalls);
+  d_syscalls = syscalls;
+  d_wc->pending.store(d_pending.size() - d_next, std::memory_order_relaxed);
+  d_wc->queued.store(queued, std::memory_order_relaxed);
+  d_wc->timers.store(d_timeouts.size(), std::memory_order_relaxed);
+}
+
+constexpr uint64_t g_minResolved = 1000; //<! per method, before an interval is trusted
+constexpr uint64_t g_minHits = 10; //<! below this the normal approximation is off
+
+/* The widest 95% interval, as a fraction, of the response and open resolver estimates that
+   come with an error estimate: the random probes, Sobol if there are replicates, and the
+   stratified estimates. Infinite while there is too little data. */
+double widestInterval(const ScanContext& ctx)
+{
+  double widest = 0;
+  auto consider = [&widest](const Estimate& e) {
+    widest = std::max(widest, 2 * e.halfWidth);
+  };
+  const unsigned int replicates = ctx.opts.replicates;
+
+  if(ctx.strata) {
+    vector<Sample> responses, open;
+    uint64_t resolved = 0, hits = 0, ores = 0;
+    for(size_t n = 0; n < ctx.strata->size(); ++n) {
+      const auto& sc = ctx.stratumCounters[n];
+      uint64_t size = (*ctx.strata)[n].space.addressCount(), probes = sc.resolved[0] + sc.resolved[1];
+      responses.push_back({size, probes, sc.responses[0] + sc.responses[1]});
+      open.push_back({size, probes, sc.openResolvers[0] + sc.openResolvers[1]});
+      resolved += probes;
+      hits += responses.back().hits;
+      ores += open.back().hits;
+    }
+    if(resolved < 2 * g_minResolved || hits < g_minHits || ores < g_minHits)
+      return INFINITY;
+    consider(stratifiedEstimate(responses));
+    consider(stratifiedEstimate(open));
+    return widest;
+  }
+
+  const Tally& rnd = ctx.tallies[RandomProbe];
+  if(rnd.resolved < g_minResolved)
+    return INFINITY;
+  consider(proportionEstimate(rnd.responses, rnd.resolved));
+  consider(proportionEstimate(rnd.openResolvers, rnd.resolved));
+  if(replicates > 1) {
+    vector<Sample> responses, open;
+    uint64_t resolved = 0, hits = 0, ores = 0;
+    for(unsigned int r = 0; r < replicates; ++r) {
+      const Tally& t = ctx.tallies[sobolTag(r)];
+      responses.push_back({0, t.resolved, t.responses});
+      open.push_back({0, t.resolved, t.openResolvers});
+      resolved += t.resolved;
+      hits += t.responses;
+      ores += t.openResolvers;
+    }
+    if(resolved < g_minResolved || hits < g_minHits || ores < g_minHits)
+      return INFINITY;
+    consider(replicateEstimate(responses));
+    consider(replicateEstimate(open));
+  }
+  return widest;
+}
+
+/* Appends a line of JSON with the counters of all workers added up, and the queue depths
+   per worker, so a running scan shows where it is held up. Only reads relaxed counters,
+   the workers never wait for this. */
+void writeStats(ostream& out, const ScanContext& ctx, double elapsed, uint64_t& lastSent, double& lastElapsed)
+{
+  uint64_t candidates = 0, rejected = 0, sent = 0, sendBlocked = 0, sendErrors = 0, rateLimited = 0, received = 0;
+  uint64_t responses = 0, openResolvers = 0, parseErrors = 0, unsolicited = 0, duplicates = 0, late = 0, timeouts = 0, untracked = 0, syscalls = 0;
+  vector<uint64_t> rtt(LatencyHistogram::s_buckets);
+  auto get = [](const std::atomic<uint64_t>& c) { return c.load(std::memory_order_relaxed); };
+  ostringstream workers;
+  for(size_t n = 0; n < ctx.counters.size(); ++n) {
+    const auto& wc = ctx.counters[n];
+    candidates += get(wc.candidates);
+    rejected += get(wc.rejected);
+    sent += get(wc.sent);
+    sendBlocked += get(wc.sendBlocked);
+    sendErrors += get(wc.sendErrors);
+    rateLimited += get(wc.rateLimited);
+    received += get(wc.received);
+    syscalls += get(wc.syscalls);
+    responses += wc.sobresponses + wc.rndresponses;
+    openResolvers += wc.openResolvers;
+    parseErrors += wc.parseErrors;
+    unsolicited += wc.unsolicited;
+    duplicates += wc.duplicates;
+    late += wc.late;
+    timeouts += wc.timeouts;
+    untracked += wc.untracked;
+    wc.rtt.addTo(rtt);
+    workers<<(n ? "," : "")<<"{\"sent\":"<<get(wc.sent)<<",\"received\":"<<get(wc.received)<<",\"pending\":"<<get(wc.pending)<<",\"queued\":"<<get(wc.queued)<<",\"timers\":"<<get(wc.timers)<<",\"outstanding\":"<<wc.outstanding<<"}";
+  }
+  double pps = elapsed > lastElapsed ? (sent - lastSent) / (elapsed - lastElapsed) : 0;
+  lastSent = sent;
+  lastElapsed = elapsed;
+
+  out<<"{\"time\":"<<std::fixed<<std::setprecision(3)<<chrono::duration<double>(chrono::system_clock::now().time_since_epoch()).count()<<",\"elapsed\":"<<elapsed;
+  out<<std::defaultfloat<<",\"pps\":"<<(uint64_t)pps<<",\"candidates\":"<<candidates<<",\"rejected\":"<<rejected<<",\"sent\":"<<sent;
+  out<<",\"send_blocked\":"<<sendBlocked<<",\"send_errors\":"<<sendErrors<<",\"rate_limited\":"<<rateLimited<<",\"received\":"<<received;
+  out<<",\"responses\":"<<responses<<",\"open_resolvers\":"<<openResolvers<<",\"parse_errors\":"<<parseErrors<<",\"unsolicited\":"<<unsolicited;
+  out<<",\"duplicates\":"<<duplicates<<",\"late\":"<<late<<",\"timeouts\":"<<timeouts<<",\"untracked\":"<<untracked;
+  out<<",\"results_dropped\":"<<(ctx.results ? ctx.results->dropped() : 0)<<",\"syscalls\":"<<syscalls;
+  out<<",\"rtt_us\":{";
+  const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+  const char* names[] = {"p50", "p90", "p99", "p999"};
+  for(unsigned int n = 0; n < 4; ++n)
+    out<<(n ? "," : "")<<"\""<<names[n]<<"\":"<<LatencyHistogram::percentile(rtt, quantiles[n]) / 1000;
+  out<<"},\"workers\":["<<workers.str()<<"]}"<<endl;
+}
+
+/* Prints the estimates of an unstratified scan, with 95% intervals where there is an error
+   estimate. The Wilson interval of the random probes is not centered on hits/probes, so
+   that one comes with its bounds. */
+void reportEstimates(const ScanContext& ctx)
+{
+  const Tally& rnd = ctx.tallies[RandomProbe];
+  Estimate r, o;
+  if(rnd.resolved) {
+    r = proportionEstimate(rnd.responses, rnd.resolved);
+    o = proportionEstimate(rnd.openResolvers, rnd.resolved);
+    cout<<"random: "<<100.0*rnd.responses/rnd.resolved<<"% ("<<100*(r.p - r.halfWidth)<<"-"<<100*(r.p + r.halfWidth)<<"%) responding, ";
+    cout<<100.0*rnd.openResolvers/rnd.resolved<<"% ("<<100*(o.p - o.halfWidth)<<"-"<<100*(o.p + o.halfWidth)<<"%) open resolvers (95% confidence)"<<endl;
+  }
+
+  const unsigned int replicates = ctx.opts.replicates;
+  vector<Sample> responses, open;
+  uint64_t resolved = 0, hits = 0, ores = 0;
+  for(unsigned int n = 0; n < replicates; ++n) {
+    const Tally& t = ctx.tallies[sobolTag(n)];
+    responses.push_back({0, t.resolved, t.responses});
+    open.push_back({0, t.resolved, t.openResolvers});
+    resolved += t.resolved;
+    hits += t.responses;
+    ores += t.openResolvers;
+  }
+  if(replicates > 1) {
+    r = replicateEstimate(responses);
+    o = replicateEstimate(open);
+    cout<<"Sobol: "<<100*r.p<<"% +/- "<<100*r.halfWidth<<" responding, ";
+    cout<<100*o.p<<"% +/- "<<100*o.halfWidth<<" open resolvers (95% confidence, "<<replicates<<" replicates)"<<endl;
+  }
+  else if(resolved)
+    cout<<"Sobol: "<<100.0*hits/resolved<<"% responding, "<<100.0*ores/resolved<<"% open resolvers (use --replicates for an error estimate)"<<endl;
+}
+
+/* Prints the stratified estimates per method, and writes those of every stratum to
+   the file 'strata', with both methods pooled */
+void reportStrata(const ScanContext& ctx)
+{
+  const Strata& strata = *ctx.strata;
+  ofstream out("strata");
+  out<<"stratum\taddresses\tprobes\tresponses\tresponse%\tlow%\thigh%\topen\topen%\tlow%\thigh%\n";
+  vector<Sample> responses[3], open[3]; // sob, rnd, both
+  for(size_t n = 0; n < strata.size(); ++n) {
+    const auto& sc = ctx.stratumCounters[n];
+    uint64_t size = strata[n].space.addressCount();
+    for(int m = 0; m < 2; ++m) {
+      responses[m].push_back({size, sc.resolved[m], sc.responses[m]});
+      open[m].push_back({size, sc.resolved[m], sc.openResolvers[m]});
+    }
+    uint64_t probes = sc.resolved[0] + sc.resolved[1];
+    uint64_t hits = sc.responses[0] + sc.responses[1], ores = sc.openResolvers[0] + sc.openResolvers[1];
+    responses[2].push_back({size, probes, hits});
+    open[2].push_back({size, probes, ores});
+    // the Wilson interval is not centered on hits/probes
+    auto r = proportionEstimate(hits, probes), o = proportionEstimate(ores, probes);
+    out<<strata[n].name<<'\t'<<size<<'\t'<<probes<<'\t'<<hits<<'\t'<<(probes ? 100.0*hits/probes : 0)<<'\t';
+    out<<100*(r.p - r.halfWidth)<<'\t'<<100*(r.p + r.halfWidth)<<'\t';
+    out<<ores<<'\t'<<(probes ? 100.0*ores/probes : 0)<<'\t'<<100*(o.p - o.halfWidth)<<'\t'<<100*(o.p + o.halfWidth)<<'\n';
+  }
+
+  const char* names[] = {"Sobol", "random", "combined"};
+  double unsampled = 0;
+  for(int m = 0; m < 3; ++m) {
+    auto r = stratifiedEstimate(responses[m], 1.96, &unsampled), o = stratifiedEstimate(open[m]);
+    cout<<names[m]<<": "<<100*r.p<<"% +/- "<<100*r.halfWidth<<" responding, ";
+    cout<<100*o.p<<"% +/- "<<100*o.halfWidth<<" open resolvers (95% confidence)"<<endl;
+  }
+  if(unsampled > 0)
+    cout<<"Strata without any probes, "<<100*unsampled<<"% of the space, are not in these estimates"<<endl;
+  cout<<"Estimates per stratum are in 'strata'"<<endl;
+}
+
+//! user and system time of the whole process so far
+double cpuSeconds()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+//! the address the kernel would send from to reach the internet, for raw packets
+uint32_t defaultSource()
+{
+  Socket s(AF_INET, SOCK_DGRAM);
+  SConnect(s, makeComboAddress(0x08080808, 53)); // nothing is sent, this only picks a route
+  ComboAddress local = makeComboAddress(0, 0);
+  socklen_t len = sizeof(local.sin4);
+  if(getsockname(s, (struct sockaddr*)&local.sin4, &len) < 0)
+    throw runtime_error(string("Finding the source address: ")+strerror(errno));
+  return ntohl(local.sin4.sin_addr.s_addr);
 }
 
 int main(int argc, char**argv)
 {
-  if(argc != 2) {
-    cout<<"Syntax: dnsscan prefixesfile\n";
+  ScanOptions opts;
+  static const struct option longopts[] = {
+    {"linear-sobol", no_argument, 0, 'l'},
+    {"sobol-seed", required_argument, 0, 's'},
+    {"sobol-start", required_argument, 0, 'S'},
+    {"threads", required_argument, 0, 't'},
+    {"rate", required_argument, 0, 'r'},
+    {"burst", required_argument, 0, 'b'},
+    {"batch", required_argument, 0, 'B'},
+    {"ip-label", no_argument, 0, 'i'},
+    {"random-case", no_argument, 0, 'c'},
+    {"timeout", required_argument, 0, 'T'},
+    {"verbose", no_argument, 0, 'v'},
+    {"results", required_argument, 0, 'R'},
+    {"exclude", required_argument, 0, 'x'},
+    {"direct", no_argument, 0, 'd'},
+    {"strata", required_argument, 0, 'g'},
+    {"neyman", no_argument, 0, 'n'},
+    {"pilot", required_argument, 0, 'p'},
+    {"probes", required_argument, 0, 'P'},
+    {"ci-width", required_argument, 0, 'w'},
+    {"replicates", required_argument, 0, 'e'},
+    {"sockets", required_argument, 0, 'k'},
+    {"raw", no_argument, 0, 'W'},
+    {"source", required_argument, 0, 'a'},
+    {"stats", required_argument, 0, 'O'},
+    {"stats-interval", required_argument, 0, 'N'},
+    {"ipv6", no_argument, 0, '6'},
+    {"v6-unit", required_argument, 0, 'U'},
+    {"v6-weight", required_argument, 0, 'G'},
+    {"v6-iid-bits", required_argument, 0, 'I'},
+    {"v6-hitlist", required_argument, 0, 'H'},
+    {0, 0, 0, 0}
+  };
+  for(int c; (c = getopt_long(argc, argv, "ls:S:t:r:b:B:icT:vR:x:dg:np:P:w:e:k:Wa:O:N:6U:G:I:H:", longopts, 0)) != -1; ) {
+    switch(c) {
+    case 'l':
+      opts.linearSobol=true;
+      break;
+    case 's':
+      opts.sobolSeed=strtoull(optarg, 0, 10);
+      break;
+    case 'S':
+      opts.sobolStart=strtoull(optarg, 0, 10);
+      break;
+    case 't':
+      opts.threads=std::max(1, atoi(optarg));
+      break;
+    case 'r':
+      opts.rate=atof(optarg);
+      break;
+    case 'b':
+      opts.burst=atof(optarg);
+      break;
+    case 'B':
+      opts.batch=std::max(1, atoi(optarg));
+      break;
+    case 'i':
+      opts.ipLabel=true;
+      break;
+    case 'c':
+      opts.randomCase=true;
+      break;
+    case 'T':
+      opts.timeout=std::max(1, atoi(optarg));
+      break;
+    case 'v':
+      opts.verbose=true;
+      break;
+    case 'R':
+      opts.resultsFile=optarg;
+      break;
+    case 'x':
+      opts.excludeFile=optarg;
+      break;
+    case 'd':
+      opts.direct=true;
+      break;
+    case 'g':
+      opts.strata=optarg;
+      break;
+    case 'n':
+      opts.neyman=true;
+      break;
+    case 'p':
+      opts.pilot=std::min(1.0, std::max(0.0, atof(optarg)));
+      break;
+    case 'P':
+      opts.probes=std::max(2, atoi(optarg));
+      break;
+    case 'w':
+      opts.ciWidth=std::max(0.0, atof(optarg));
+      break;
+    case 'e':
+      opts.replicates=std::min(g_maxReplicates, (unsigned int)std::max(1, atoi(optarg)));
+      break;
+    case 'k':
+      opts.sockets=std::max(1, atoi(optarg));
+      break;
+    case 'W':
+      opts.raw=true;
+      break;
+    case 'a': {
+      struct in_addr addr;
+      if(inet_pton(AF_INET, optarg, &addr) != 1) {
+        cerr<<"Source address '"<<optarg<<"' is not an IPv4 address"<<endl;
+        return EXIT_FAILURE;
+      }
+      opts.source=ntohl(addr.s_addr);
+      break;
+    }
+    case 'O':
+      opts.statsFile=optarg;
+      break;
+    case 'N':
+      opts.statsInterval=std::max(10, atoi(optarg));
+      break;
+    case '6':
+      opts.ipv6=true;
+      break;
+    case 'U':
+      opts.v6Unit=std::min(128, std::max(1, atoi(optarg)));
+      break;
+    case 'G':
+      if(string(optarg) != "unit" && string(optarg) != "range") {
+        cerr<<"--v6-weight is either 'unit' or 'range'"<<endl;
+        return EXIT_FAILURE;
+      }
+      opts.v6PerRange = string(optarg) == "range";
+      break;
+    case 'I':
+      opts.v6IIDBits=std::min(64, std::max(0, atoi(optarg)));
+      break;
+    case 'H':
+      opts.v6Hitlist=optarg;
+      break;
+    default:
+      return EXIT_FAILURE;
+    }
+  }
+  if(argc - optind != 1) {
+    cout<<"Syntax: dnsscan [--linear-sobol] [--sobol-seed n] [--sobol-start index] [--threads n] [--sockets n] [--rate pps] [--burst n] [--batch n] [--ip-label] [--random-case] [--timeout ms] [--verbose] [--results file] [--exclude prefixesfile] [--direct] [--strata slash8|length|mappingfile] [--neyman] [--pilot fraction] [--probes n] [--ci-width percent] [--replicates n] [--raw [--source ip]] [--stats file [--stats-interval ms]] [--ipv6 [--v6-unit length] [--v6-weight unit|range] [--v6-iid-bits n] [--v6-hitlist file]] prefixesfile|snapshot\n";
+    return EXIT_FAILURE;
+  }
+  try {
+    if(opts.ipv6 && (opts.raw || opts.direct || opts.ipLabel || !opts.strata.empty() || !opts.excludeFile.empty() || !opts.resultsFile.empty())) {
+      cerr<<"--ipv6 does not go with --raw, --direct, --ip-label, --strata, --exclude or --results"<<endl;
+      return EXIT_FAILURE;
+    }
+    if(opts.raw && !opts.source)
+      opts.source = defaultSource();
+    // a batch goes out at once, so it stays within a burst, with room to spare for a late wakeup
+    if(opts.rate > 0)
+      opts.batch = std::max(1U, std::min(opts.batch, ((unsigned int)opts.burst + 1) / 2));
+    IPv4Table table;
+    if(opts.ipv6)
+      ; // the IPv6 prefixes are read below
+    else if(opts.excludeFile.empty())
+      table = loadIPv4Table(argv[optind]);
+    else {
+      auto targets = loadPrefixSet(argv[optind]).subtract(loadPrefixSet(opts.excludeFile));
+      table = IPv4Table(targets.prefixes());
+    }
+    ScanContext ctx(opts, std::move(table));
+    if(opts.ipv6) {
+      if(IPv4Table::isSnapshot(argv[optind]))
+        throw runtime_error("An IPv6 scan needs the prefixes file, not a snapshot");
+      vector<IPv6Prefix> announced;
+      parsePrefixFile(argv[optind], nullptr, &announced);
+      ctx.sampler6.reset(new IPv6Sampler(IPv6PrefixSet(announced), opts.v6Unit, opts.v6PerRange ? IPv6Sampler::Weighting::Range : IPv6Sampler::Weighting::Unit, opts.v6IIDBits));
+      if(!opts.v6Hitlist.empty()) {
+        vector<IPv6Prefix> hitlist;
+        parsePrefixFile(opts.v6Hitlist, nullptr, &hitlist);
+        if(hitlist.empty())
+          throw runtime_error("No IPv6 addresses in hitlist '"+opts.v6Hitlist+"'");
+        ctx.sampler6->seedPatterns(hitlist);
+      }
+      cout<<"Sampling from "<<(double)ctx.sampler6->units()<<(opts.v6PerRange ? " announced ranges" : " announced units")<<endl;
+    }
+    if(!opts.strata.empty()) {
+      PrefixSet space(ctx.table);
+      if(opts.strata == "slash8")
+        ctx.strata.reset(new Strata(Strata::bySlash8(space)));
+      else if(opts.strata == "length") {
+        if(IPv4Table::isSnapshot(argv[optind]))
+          throw runtime_error("Stratifying by prefix length needs the prefixes file, not a snapshot");
+        ctx.strata.reset(new Strata(Strata::byPrefixLength(loadIPv4Prefixes(argv[optind]), space)));
+      }
+      else
+        ctx.strata.reset(new Strata(Strata::byMapping(opts.strata, space)));
+      if(!ctx.strata->size())
+        throw runtime_error("No announced addresses to scan");
+      ctx.stratumCounters.reset(new StratumCounters[ctx.strata->size()]());
+      cout<<"Scanning "<<ctx.strata->size()<<" strata"<<endl;
+    }
+
+    /* every worker gets sockets of its own, which stay open between the phases of a
+       stratified scan so answers that come in between are still seen */
+    vector<Socket> sockets, rawReceivers;
+    sockets.reserve(opts.sockets * opts.threads);
+    for(unsigned int n = 0; n < opts.sockets * opts.threads; ++n) {
+      if(opts.raw)
+        sockets.emplace_back(AF_INET, SOCK_RAW, IPPROTO_RAW);
+      else
+        sockets.emplace_back(opts.ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM);
+      SetNonBlocking(sockets.back());
+    }
+    if(opts.raw) {
+      rawReceivers.reserve(opts.threads);
+      for(unsigned int n = 0; n < opts.threads; ++n) {
+        rawReceivers.emplace_back(AF_INET, SOCK_RAW, IPPROTO_UDP);
+        SetNonBlocking(rawReceivers.back());
+      }
+    }
+
+    std::random_device rd{};
+    ofstream sobplot("sobplot"), rndplot("rndplot"), oresplot("oresplot"), comboplot("comboplot");
+    auto plot = [&]() {
+      uint32_t sobmatches=0, rndmatches=0, sobresponses=0, rndresponses=0, openResolvers=0;
+      for(const auto& wc : ctx.counters) {
+        sobmatches += wc.sobmatches;
+        rndmatches += wc.rndmatches;
+        sobresponses += wc.sobresponses;
+        rndresponses += wc.rndresponses;
+        openResolvers += wc.openResolvers;
+      }
+      cout<<(sobmatches + rndmatches)<<endl;
+      sobplot << sobmatches << '\t' << sobresponses << '\t' << (100.0*sobresponses/sobmatches) << '\n';
+      rndplot << rndmatches << '\t' << rndresponses << '\t' << (100.0*rndresponses/rndmatches) << '\n';
+      oresplot << (sobmatches + rndmatches) << '\t' << openResolvers << '\t' << (100.0*openResolvers / (sobmatches + rndmatches)) << '\n';
+      comboplot << (sobmatches + rndmatches) << '\t' << sobresponses + rndresponses << '\t' << 100.0*(sobresponses+rndresponses)/(sobmatches+rndmatches) << '\n';
+    };
+
+    // starts the workers, and plots a line every 1024 probes until 'target' probes have gone out
+    auto runWorkers = [&](uint32_t target) {
+      vector<std::thread> workers;
+      for(unsigned int n = 0; n < opts.threads; ++n) {
+        vector<int> own;
+        for(unsigned int k = 0; k < opts.sockets; ++k)
+          own.push_back(sockets[n * opts.sockets + k]);
+        int rawReceiver = opts.raw ? (int)rawReceivers[n] : -1;
+        workers.emplace_back([&ctx, n, own, rawReceiver](uint32_t seed) {
+            try {
+              ScanWorker(&ctx, n, seed, own, rawReceiver).run();
+            }
+            catch(...) { // the others stop too, and main reports this
+              ctx.failures[n] = std::current_exception();
+              ctx.stopSending = true;
+            }
+          }, rd());
+      }
+      for(uint32_t next = 0, checks = 0; ctx.totalmatches < target && !ctx.stopSending; ++checks) {
+        if(ctx.totalmatches >= next) {
+          plot();
+          next = ctx.totalmatches + 1024;
+        }
+        if(opts.ciWidth > 0 && !(checks % 10)) {
+          // the probes still in flight narrow the intervals further once they resolve, about as 1/sqrt(probes)
+          uint64_t resolved = 0;
+          for(unsigned int t = 0; t < 2 * opts.replicates; ++t)
+            resolved += ctx.tallies[t].resolved;
+          double projected = widestInterval(ctx) * sqrt((double)resolved / std::max<uint64_t>(resolved, ctx.totalmatches));
+          if(resolved && projected <= opts.ciWidth / 100) {
+            cout<<"Confidence intervals will be narrower than "<<opts.ciWidth<<" percentage points once the probes in flight are in, stopping"<<endl;
+            ctx.stopSending = true;
+          }
+        }
+        usleep(10000);
+      }
+      cout<<"Sent all probes, waiting for responses"<<endl;
+      for(auto& t : workers)
+        t.join();
+    };
+
+    int64_t started = monotonicNs();
+    double cpuStart = cpuSeconds();
+    // the stats thread keeps writing while the workers wait for the last answers, and writes a final line
+    std::atomic<bool> statsDone{false};
+    std::thread statsWriter;
+    ofstream statsOut;
+    if(!opts.statsFile.empty()) {
+      statsOut.open(opts.statsFile, std::ios::app);
+      if(!statsOut)
+        throw runtime_error("Can't open stats file '"+opts.statsFile+"': "+strerror(errno));
+      statsWriter = std::thread([&ctx, &statsDone, &statsOut, started]() {
+          uint64_t lastSent = 0;
+          double lastElapsed = 0;
+          for(bool last = false; !last; ) {
+            int64_t due = monotonicNs() + ctx.opts.statsInterval * 1000000LL;
+            while(!(last = statsDone) && monotonicNs() < due)
+              usleep(10000);
+            writeStats(statsOut, ctx, (monotonicNs() - started) / 1e9, lastSent, lastElapsed);
+          }
+        });
+    }
+    if(!ctx.strata)
+      runWorkers(opts.probes);
+    else {
+      /* half the probes are Sobol and half random, and every stratum gets its share of
+         both. For Neyman allocation a proportional pilot comes first, and the rest of the
+         probes go where the pilot found the most variance. */
+      size_t numStrata = ctx.strata->size();
+      vector<uint64_t> sizes(numStrata), sent(numStrata, 0);
+      for(size_t n = 0; n < numStrata; ++n)
+        sizes[n] = (*ctx.strata)[n].space.addressCount();
+      vector<double> bySize(sizes.begin(), sizes.end());
+      auto runPhase = [&](const vector<uint64_t>& allocation) {
+        if(ctx.stopSending)
+          return;
+        ctx.plan.clear();
+        uint64_t total = 0;
+        for(size_t n = 0; n < numStrata; ++n) {
+          for(uint64_t done = 0; done < allocation[n]; done += g_blocksize)
+            ctx.plan.push_back({(uint32_t)n, sent[n] + done, (uint32_t)std::min((uint64_t)g_blocksize, allocation[n] - done)});
+          sent[n] += allocation[n];
+          total += allocation[n];
+        }
+        // interleave strata, so the workers share the load and a partial scan covers everything
+        std::shuffle(ctx.plan.begin(), ctx.plan.end(), std::mt19937(rd()));
+        runWorkers(ctx.totalmatches + 2 * total);
+      };
+
+      uint64_t perMethod = opts.probes / 2;
+      uint64_t first = opts.neyman ? perMethod * opts.pilot : perMethod;
+      runPhase(allocateProbes(sizes, bySize, first, 2));
+      if(opts.neyman) {
+        vector<double> weights(numStrata);
+        for(size_t n = 0; n < numStrata; ++n) {
+          const auto& sc = ctx.stratumCounters[n];
+          double probes = sc.probes[0] + sc.probes[1], hits = sc.responses[0] + sc.responses[1];
+          double p = (hits + 0.5) / (probes + 1); // so a pilot without responses still gets some weight
+          weights[n] = sizes[n] * sqrt(p * (1 - p));
+        }
+        // where the pilot did not reach the Neyman allocation yet, top it up
+        auto target = allocateProbes(sizes, weights, perMethod, 2);
+        vector<uint64_t> room(numStrata);
+        vector<double> shortfall(numStrata);
+        for(size_t n = 0; n < numStrata; ++n) {
+          room[n] = sizes[n] - sent[n];
+          shortfall[n] = target[n] > sent[n] ? target[n] - sent[n] : 0;
+        }
+        runPhase(allocateProbes(room, shortfall, perMethod - std::min(perMethod, first), 0));
+      }
+    }
+    plot();
+    double elapsed = (monotonicNs() - started) / 1e9, cpu = cpuSeconds() - cpuStart;
+    if(statsWriter.joinable()) {
+      statsDone = true;
+      statsWriter.join();
+    }
+    for(const auto& failure : ctx.failures)
+      if(failure)
+        std::rethrow_exception(failure);
+
+    uint64_t responses=0, rttSum=0, unsolicited=0, duplicates=0, late=0, untracked=0, timeouts=0, parseErrors=0, probes=0, syscalls=0;
+    for(const auto& wc : ctx.counters) {
+      probes += wc.sobmatches + wc.rndmatches;
+      syscalls += wc.syscalls;
+      responses += wc.sobresponses + wc.rndresponses;
+      rttSum += wc.rttSum;
+      unsolicited += wc.unsolicited;
+      duplicates += wc.duplicates;
+      late += wc.late;
+      untracked += wc.untracked;
+      timeouts += wc.timeouts;
+      parseErrors += wc.parseErrors;
+    }
+    cout<<"\nDone"<<endl;
+    if(opts.raw) { // raw scans time out all probes, and only know at the end how many were answered
+      timeouts -= std::min(timeouts, responses);
+      cout<<timeouts<<" probes timed out"<<endl;
+    }
+    else
+      cout<<timeouts<<" probes timed out, average RTT "<<(responses ? rttSum/1000000.0/responses : 0)<<" ms"<<endl;
+    cout<<unsolicited<<" unsolicited, "<<duplicates<<" duplicate, "<<late<<" late and "<<parseErrors<<" malformed responses ignored";
+    if(untracked)
+      cout<<", "<<untracked<<" probes not tracked";
+    cout<<endl;
+    if(probes)
+      cout<<"Sent "<<probes<<" probes in "<<elapsed<<"s: "<<(uint64_t)(probes / elapsed)<<" probes/s, "<<1e6 * cpu / probes<<" us CPU and "<<(double)syscalls / probes<<" syscalls per probe"<<endl;
+
+    if(ctx.strata)
+      reportStrata(ctx);
+    else
+      reportEstimates(ctx);
+
+    // last, so a log that fails to close does not cost the estimates
+    if(ctx.results) {
+      ctx.results->close();
+      if(ctx.results->dropped())
+        cout<<ctx.results->dropped()<<" records could not be written to the results log"<<endl;
+    }
+  }
+  catch(std::exception& e) {
+    cerr<<"Error: "<<e.what()<<endl;
     return EXIT_FAILURE;
   }
-  NetmaskTree<bool> table;
-
-  loadNetmaskTree(argv[1], table);
-  
-  SobolSequence ss;
-  vector<double> ip(4);
-
-  std::random_device rd{};
-  std::mt19937 gen{rd()};
-  std::uniform_real_distribution<> d(0, 1.0);
-  
-  unsigned int sobmatches=0, rndmatches=0;
-
-  Socket sobsock(AF_INET, SOCK_DGRAM), rndsock(AF_INET, SOCK_DGRAM);
-
-  uint32_t sobresponses=0, rndresponses=0;
-  std::thread sobthread(listenerThread, (int)sobsock, &sobresponses, "sob");
-  std::thread rndthread(listenerThread, (int)rndsock, &rndresponses, "rnd");
-  
-  sobthread.detach();
-  rndthread.detach();
-  string dnsquery = makeDNSQuery("whoami-ecs.lua.powerdns.org");
-  ofstream sobplot("sobplot"), rndplot("rndplot"), oresplot("oresplot"), comboplot("comboplot");
-  for(unsigned int n = 0; (sobmatches + rndmatches) < 100000 ; ++n) {
-    ss.get(4, ip);
-    auto str = makeIPStr(ip[0], ip[1], ip[2], ip[3]);
-    ComboAddress dst(str, 53);
-    if(table.match(dst)) {
-      ++sobmatches;
-      SSendto(sobsock, dnsquery, dst);
-    }
-    str = makeIPStr(d(gen), d(gen), d(gen), d(gen));
-    dst=ComboAddress(str, 53);
-    if(table.match(dst)) {
-      SSendto(rndsock, dnsquery, dst);
-      ++rndmatches;
-    }
-    usleep(1000);
-
-
-    if(!(n%1024)) {
-      cout<<n<<endl;
-      sobplot << sobmatches << '\t' << sobresponses << '\t' << (100.0*sobresponses/sobmatches) << endl;
-      rndplot << rndmatches << '\t' << rndresponses << '\t' << (100.0*rndresponses/rndmatches) << endl;
-      oresplot << (sobmatches + rndmatches) << '\t' << g_openResolvers << '\t' << (100.0*g_openResolvers / (sobmatches + rndmatches)) << endl;
-      comboplot << (sobmatches + rndmatches) << '\t' << sobresponses + rndresponses << '\t' << 100.0*(sobresponses+rndresponses)/(sobmatches+rndmatches) << endl;
-    }
-    
-  }
-  cout<<"\nDone"<<endl;
 }
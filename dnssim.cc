@@ -0,0 +1,351 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include "sclasses.hh"
+#include "common.hh"
+#include "batchio.hh"
+#include "eventloop.hh"
+#include "ratelimit.hh"
+#include "timerwheel.hh"
+#include "cacheline.hh"
+#include <getopt.h>
+
+using namespace std;
+
+/* A synthetic internet on the loopback, for measuring dnsscan without sending anything
+   out. In a network namespace where every address is local:
+
+     ip link set lo up
+     ip route add local 0.0.0.0/0 dev lo
+
+   every probe dnsscan sends ends up here, and is answered from the address it was sent
+   to. See bench.sh. */
+
+//! splitmix64 finalizer
+static uint64_t mix(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+//! x / 2^64, in [0, 1)
+static double unit(uint64_t x)
+{
+  return (x >> 11) * 0x1.0p-53;
+}
+
+struct SimOptions
+{
+  unsigned int threads{1};
+  uint16_t port{53};
+  double respond{0.1}; //<! mean response probability of an announced range
+  double spread{1.0};  //<! ranges get 'respond' times a factor in [1 - spread, 1 + spread]
+  double open{0.1};    //<! fraction of the responders that are open resolvers
+  double loss{0};      //<! fraction of the queries that are dropped
+  double rtt{0};       //<! ms, least round trip time
+  double jitter{0};    //<! ms, mean of the exponentially distributed delay on top
+  uint64_t seed{1};
+};
+
+/** Who answers. Every announced range gets a response probability of its own, and whether
+    an address answers, and whether it is an open resolver, is a keyed hash of the address.
+    So an address always behaves the same, and the true fractions over the announced space
+    are known up front. Addresses that are not announced never answer.
+*/
+class Population
+{
+public:
+  Population(PrefixSet&& announced, const SimOptions& opts) : d_announced(std::move(announced)), d_seed(opts.seed), d_open(opts.open)
+  {
+    for(const auto& r : d_announced.ranges()) {
+      double factor = 1 + opts.spread * (2 * unit(mix(d_seed ^ r.first)) - 1);
+      d_respond.push_back(std::min(1.0, std::max(0.0, opts.respond * factor)));
+    }
+  }
+
+  enum Behaviour { Unannounced, Silent, Responder, OpenResolver };
+
+  Behaviour behaviour(uint32_t ip) const
+  {
+    const auto& ranges = d_announced.ranges();
+    auto iter = upper_bound(ranges.begin(), ranges.end(), ip, [](uint32_t ip, const PrefixSet::Range& r) {
+        return ip < r.first;
+      });
+    if(iter == ranges.begin() || ip > (iter - 1)->last)
+      return Unannounced;
+    uint64_t h = mix(d_seed + ip);
+    if(unit(h) >= d_respond[iter - 1 - ranges.begin()])
+      return Silent;
+    return unit(mix(h)) < d_open ? OpenResolver : Responder;
+  }
+
+  //! the expected fraction of announced addresses that answers
+  double responding() const
+  {
+    double sum = 0;
+    for(size_t n = 0; n < d_respond.size(); ++n)
+      sum += d_respond[n] * d_announced.ranges()[n].size();
+    return sum / d_announced.addressCount();
+  }
+
+  double openResolvers() const
+  {
+    return responding() * d_open;
+  }
+
+  uint64_t addressCount() const
+  {
+    return d_announced.addressCount();
+  }
+
+private:
+  PrefixSet d_announced;
+  vector<double> d_respond; //<! per range of d_announced
+  uint64_t d_seed;
+  double d_open;
+};
+
+//! Counters for one responder, padded so the next responder's are on another cache line
+struct SimCounters
+{
+  std::atomic<uint64_t> queries{0}, answered{0}, open{0}, lost{0}, unannounced{0}, malformed{0};
+  CacheLinePad<> d_pad;
+};
+
+/** One thread with its own SO_REUSEPORT socket, so the kernel spreads the probes over the
+    responders. Answers are delayed through a timing wheel if there is an RTT to simulate.
+*/
+class Responder
+{
+public:
+  Responder(const Population& pop, const SimOptions& opts, int sock, SimCounters* counters, uint64_t seed);
+  void run();
+
+private:
+  struct Delayed
+  {
+    ComboAddress to;
+    uint32_t from;
+    uint16_t len;
+    char packet[256];
+  };
+
+  void receive();
+  void answer(const char* query, size_t len, const ComboAddress& to, uint32_t from, int64_t now);
+  void queue(const char* packet, size_t len, const ComboAddress& to, uint32_t from);
+
+  const Population& d_pop;
+  const SimOptions& d_opts;
+  SimCounters* d_counters;
+  std::mt19937_64 d_gen;
+  std::exponential_distribution<double> d_jitter;
+  EventLoop d_loop;
+  UDPBatchReceiver d_in;
+  UDPBatchSender d_out;
+  TimerWheel<Delayed> d_delayed;
+  bool d_writable{true};
+};
+
+Responder::Responder(const Population& pop, const SimOptions& opts, int sock, SimCounters* counters, uint64_t seed) :
+  d_pop(pop), d_opts(opts), d_counters(counters), d_gen(seed), d_jitter(opts.jitter > 0 ? 1 / (opts.jitter * 1000000) : 1),
+  d_in(sock, 64, 1500, true), d_out(sock, 64, 512, true), d_delayed(100000, monotonicNs())
+{
+  d_loop.add(sock, EPOLLIN, [this, sock](uint32_t events) {
+      if(events & EPOLLOUT) {
+        d_writable = true;
+        d_loop.modify(sock, EPOLLIN);
+      }
+      if(events & EPOLLIN)
+        receive();
+    });
+}
+
+// a batch at a time, so what was answered goes out before the next batch is read
+void Responder::receive()
+{
+  int64_t now = monotonicNs();
+  unsigned int num = d_in.receive(MSG_DONTWAIT);
+  for(unsigned int n = 0; n < num; ++n)
+    answer(d_in.data(n), d_in.size(n), d_in.from(n), d_in.destination(n), now);
+}
+
+void Responder::answer(const char* query, size_t len, const ComboAddress& to, uint32_t from, int64_t now)
+{
+  ++d_counters->queries;
+  if(d_opts.loss > 0 && unit(d_gen()) < d_opts.loss) {
+    ++d_counters->lost;
+    return;
+  }
+  auto behaviour = d_pop.behaviour(from);
+  if(behaviour == Population::Unannounced)
+    ++d_counters->unannounced;
+  if(behaviour < Population::Responder)
+    return;
+  bool open = behaviour == Population::OpenResolver;
+
+  // the answer is the header and question of the query, with a TXT record if we resolve
+  size_t pos = 12;
+  while(pos < len && query[pos] && !(query[pos] & 0xc0))
+    pos += (uint8_t)query[pos] + 1;
+  pos += 5;
+  constexpr size_t answerSize = 2 + 10 + 6;
+  if(len < 12 || pos > len || query[2] & 0x80 || pos + answerSize > sizeof(Delayed::packet)) {
+    ++d_counters->malformed;
+    return;
+  }
+  char packet[sizeof(Delayed::packet)];
+  memcpy(packet, query, pos);
+  packet[2] |= 0x80;              // QR
+  packet[3] = open ? 0x80 : 0x85; // RA, and NOERROR or REFUSED
+  memset(packet + 6, 0, 6);
+  if(open) {
+    static const char txt[answerSize] = {'\xc0', 12, 0, 16, 0, 1, 0, 0, 0, 60, 0, 6, 5, 'h', 'e', 'l', 'l', 'o'};
+    memcpy(packet + pos, txt, answerSize);
+    pos += answerSize;
+    packet[7] = 1;
+    ++d_counters->open;
+  }
+  ++d_counters->answered;
+
+  double delay = d_opts.rtt * 1000000 + (d_opts.jitter > 0 ? d_jitter(d_gen) : 0);
+  if(delay < 1) {
+    queue(packet, pos, to, from);
+    return;
+  }
+  Delayed d;
+  d.to = to;
+  d.from = from;
+  d.len = pos;
+  memcpy(d.packet, packet, pos);
+  d_delayed.add(now + (int64_t)delay, d);
+}
+
+void Responder::queue(const char* packet, size_t len, const ComboAddress& to, uint32_t from)
+{
+  if(d_out.full() && d_out.flush() == 0)
+    return; // the socket buffer is full, this answer is lost like a real one would be
+  memcpy(d_out.buffer(), packet, len);
+  d_out.add(len, to, from);
+}
+
+void Responder::run()
+{
+  for(;;) {
+    d_delayed.advance(monotonicNs(), [this](const Delayed& d) { queue(d.packet, d.len, d.to, d.from); });
+    if(d_out.queued()) {
+      d_out.flush();
+      if(d_out.queued() && d_writable) {
+        d_writable = false;
+        d_loop.modify(d_out.getSocket(), EPOLLIN | EPOLLOUT);
+      }
+    }
+    d_loop.poll(d_delayed.empty() ? monotonicNs() + 1000000000 : monotonicNs() + 100000);
+  }
+}
+
+int main(int argc, char**argv)
+{
+  SimOptions opts;
+  static const struct option longopts[] = {
+    {"threads", required_argument, 0, 't'},
+    {"port", required_argument, 0, 'p'},
+    {"respond", required_argument, 0, 'r'},
+    {"spread", required_argument, 0, 's'},
+    {"open", required_argument, 0, 'o'},
+    {"loss", required_argument, 0, 'l'},
+    {"rtt", required_argument, 0, 'T'},
+    {"jitter", required_argument, 0, 'j'},
+    {"seed", required_argument, 0, 'S'},
+    {0, 0, 0, 0}
+  };
+  for(int c; (c = getopt_long(argc, argv, "t:p:r:s:o:l:T:j:S:", longopts, 0)) != -1; ) {
+    switch(c) {
+    case 't':
+      opts.threads=std::max(1, atoi(optarg));
+      break;
+    case 'p':
+      opts.port=atoi(optarg);
+      break;
+    case 'r':
+      opts.respond=std::min(1.0, std::max(0.0, atof(optarg)));
+      break;
+    case 's':
+      opts.spread=std::min(1.0, std::max(0.0, atof(optarg)));
+      break;
+    case 'o':
+      opts.open=std::min(1.0, std::max(0.0, atof(optarg)));
+      break;
+    case 'l':
+      opts.loss=std::min(1.0, std::max(0.0, atof(optarg)));
+      break;
+    case 'T':
+      opts.rtt=std::max(0.0, atof(optarg));
+      break;
+    case 'j':
+      opts.jitter=std::max(0.0, atof(optarg));
+      break;
+    case 'S':
+      opts.seed=strtoull(optarg, 0, 10);
+      break;
+    default:
+      return EXIT_FAILURE;
+    }
+  }
+  if(argc - optind != 1) {
+    cout<<"Syntax: dnssim [--threads n] [--port n] [--respond fraction] [--spread fraction] [--open fraction] [--loss fraction] [--rtt ms] [--jitter ms] [--seed n] prefixesfile|snapshot\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    Population pop(PrefixSet(loadIPv4Table(argv[optind])), opts);
+    if(!pop.addressCount())
+      throw runtime_error("No announced addresses to answer for");
+    cout<<"Truth: "<<100 * pop.responding()<<"% responding, "<<100 * pop.openResolvers()<<"% open resolvers"<<endl;
+    if(opts.loss > 0)
+      cout<<"Observable with "<<100 * opts.loss<<"% loss: "<<100 * pop.responding() * (1 - opts.loss)<<"% responding, "<<100 * pop.openResolvers() * (1 - opts.loss)<<"% open resolvers"<<endl;
+
+    vector<Socket> sockets;
+    for(unsigned int n = 0; n < opts.threads; ++n) {
+      sockets.emplace_back(AF_INET, SOCK_DGRAM);
+      SSetsockopt(sockets.back(), SOL_SOCKET, SO_REUSEPORT, 1);
+      SSetsockopt(sockets.back(), SOL_SOCKET, SO_RCVBUF, 8 << 20);
+      SetNonBlocking(sockets.back());
+      SBind(sockets.back(), ComboAddress("0.0.0.0", opts.port));
+    }
+    vector<SimCounters> counters(opts.threads);
+    for(unsigned int n = 0; n < opts.threads; ++n) {
+      std::thread([&pop, &opts, &sockets, &counters, n]() {
+          Responder(pop, opts, sockets[n], &counters[n], opts.seed + n + 1).run();
+        }).detach();
+    }
+    cout<<"Listening on port "<<opts.port<<" with "<<opts.threads<<" threads"<<endl;
+
+    // a line per second while there is traffic, until killed
+    for(uint64_t reported = 0;;) {
+      sleep(1);
+      uint64_t queries = 0, answered = 0, open = 0, lost = 0, unannounced = 0, malformed = 0;
+      for(const auto& c : counters) {
+        queries += c.queries;
+        answered += c.answered;
+        open += c.open;
+        lost += c.lost;
+        unannounced += c.unannounced;
+        malformed += c.malformed;
+      }
+      if(queries == reported)
+        continue;
+      cout<<queries<<" queries, "<<answered<<" answered, "<<open<<" as open resolver, "<<lost<<" lost, "<<unannounced<<" to unannounced addresses, "<<malformed<<" malformed"<<endl;
+      reported = queries;
+    }
+  }
+  catch(std::exception& e) {
+    cerr<<"Error: "<<e.what()<<endl;
+    return EXIT_FAILURE;
+  }
+}
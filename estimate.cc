@@ -0,0 +1,62 @@
+#include "estimate.hh"
+#include <algorithm>
+using namespace std;
+
+Estimate proportionEstimate(uint64_t hits, uint64_t n, double z)
+{
+  if(!n)
+    return {0, 1};
+  double p = (double)hits / n, z2 = z * z;
+  double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+  double halfWidth = z * sqrt(p * (1 - p) / n + z2 / (4.0 * n * n)) / (1 + z2 / n);
+  return {center, halfWidth};
+}
+
+Estimate stratifiedEstimate(const vector<Sample>& samples, double z, double* unsampled)
+{
+  double population = 0, sampled = 0;
+  for(const auto& s : samples) {
+    population += s.size;
+    if(s.probes)
+      sampled += s.size;
+  }
+  if(unsampled)
+    *unsampled = population > 0 ? 1 - sampled / population : 0;
+  if(sampled <= 0)
+    return {0, 1};
+
+  double p = 0, var = 0;
+  for(const auto& s : samples) {
+    if(!s.probes)
+      continue;
+    double w = s.size / sampled, ph = (double)s.hits / s.probes;
+    p += w * ph;
+    var += w * w * ph * (1 - ph) / std::max(s.probes - 1, (uint64_t)1);
+  }
+  return {p, z * sqrt(var)};
+}
+
+double tQuantile95(uint64_t df)
+{
+  static const double table[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  if(!df)
+    return INFINITY;
+  if(df <= sizeof(table) / sizeof(table[0]))
+    return table[df - 1];
+  return 1.96 + 2.4 / df; // close enough beyond 30
+}
+
+Estimate replicateEstimate(const vector<Sample>& replicates)
+{
+  RunningStats stats;
+  for(const auto& r : replicates)
+    if(r.probes)
+      stats.add((double)r.hits / r.probes);
+  if(stats.count() < 2)
+    return {stats.mean(), 1};
+  return {stats.mean(), tQuantile95(stats.count() - 1) * sqrt(stats.variance() / stats.count())};
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Estimators for the proportions a scan measures, like the fraction of addresses that
+   respond, with confidence intervals. */
+
+//! A proportion with a confidence interval of +/- halfWidth
+struct Estimate
+{
+  double p;
+  double halfWidth;
+};
+
+//! Wilson score interval for hits out of n, z = 1.96 gives 95%. Its center is not quite hits/n
+Estimate proportionEstimate(uint64_t hits, uint64_t n, double z = 1.96);
+
+//! Probes into a stratum or replicate, and how many of them were hits
+struct Sample
+{
+  uint64_t size;   //<! addresses in the stratum, unused for replicates
+  uint64_t probes;
+  uint64_t hits;
+};
+
+/** Combined estimate over strata, weighting every stratum by its size. Strata without
+    probes can't be estimated, these are left out and their share goes into 'unsampled'. */
+Estimate stratifiedEstimate(const std::vector<Sample>& samples, double z = 1.96, double* unsampled = nullptr);
+
+//! Mean and variance of a stream of values, with Welford's update
+class RunningStats
+{
+public:
+  void add(double x)
+  {
+    ++d_n;
+    double delta = x - d_mean;
+    d_mean += delta / d_n;
+    d_m2 += delta * (x - d_mean);
+  }
+  uint64_t count() const
+  {
+    return d_n;
+  }
+  double mean() const
+  {
+    return d_mean;
+  }
+  //<! sample variance
+  double variance() const
+  {
+    return d_n > 1 ? d_m2 / (d_n - 1) : 0;
+  }
+
+private:
+  uint64_t d_n{0};
+  double d_mean{0}, d_m2{0};
+};
+
+//! two-sided 95% quantile of Student's t distribution
+double tQuantile95(uint64_t df);
+
+/** Randomized quasi-Monte Carlo estimate from independently scrambled replicates. Points of
+    one Sobol sequence are not independent, so the error can't come from a single one, but
+    the replicate means are independent and their spread gives a 95% interval. */
+Estimate replicateEstimate(const std::vector<Sample>& replicates);
@@ -0,0 +1,82 @@
+#include "eventloop.hh"
+#include "ratelimit.hh"
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+using namespace std;
+
+EventLoop::EventLoop() : d_events(64)
+{
+  d_epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(d_epfd < 0)
+    throw runtime_error(string("epoll_create1: ")+strerror(errno));
+  // steady_clock, which monotonicNs() uses, is CLOCK_MONOTONIC
+  d_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(d_timerfd < 0) {
+    close(d_epfd);
+    throw runtime_error(string("timerfd_create: ")+strerror(errno));
+  }
+  add(d_timerfd, EPOLLIN, [this](uint32_t) {
+      uint64_t expirations;
+      ++d_syscalls;
+      if(read(d_timerfd, &expirations, sizeof(expirations)) == sizeof(expirations))
+        d_armed = 0;
+    });
+}
+
+EventLoop::~EventLoop()
+{
+  close(d_timerfd);
+  close(d_epfd);
+}
+
+void EventLoop::add(int fd, uint32_t events, Callback callback)
+{
+  struct epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = fd;
+  if(epoll_ctl(d_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    throw runtime_error(string("Adding to epoll: ")+strerror(errno));
+  if((size_t)fd >= d_callbacks.size())
+    d_callbacks.resize(fd + 1);
+  d_callbacks[fd] = std::move(callback);
+}
+
+void EventLoop::modify(int fd, uint32_t events)
+{
+  struct epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = fd;
+  ++d_syscalls;
+  if(epoll_ctl(d_epfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    throw runtime_error(string("Modifying epoll: ")+strerror(errno));
+}
+
+void EventLoop::poll(int64_t deadline)
+{
+  int timeout = 0;
+  if(deadline > monotonicNs()) {
+    timeout = -1;
+    if(deadline != d_armed) {
+      struct itimerspec its{};
+      its.it_value.tv_sec = deadline / 1000000000;
+      its.it_value.tv_nsec = deadline % 1000000000;
+      ++d_syscalls;
+      if(timerfd_settime(d_timerfd, TFD_TIMER_ABSTIME, &its, nullptr) < 0)
+        throw runtime_error(string("timerfd_settime: ")+strerror(errno));
+      d_armed = deadline;
+    }
+  }
+  ++d_syscalls;
+  int num = epoll_wait(d_epfd, d_events.data(), d_events.size(), timeout);
+  if(num < 0) {
+    if(errno == EINTR)
+      return;
+    throw runtime_error(string("epoll_wait: ")+strerror(errno));
+  }
+  for(int n = 0; n < num; ++n)
+    d_callbacks[d_events[n].data.fd](d_events[n].events);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <sys/epoll.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/** A level-triggered epoll loop, for one thread. File descriptors come with a callback
+    that gets the ready events, EPOLLIN and EPOLLOUT. poll() waits until something is
+    ready or until a deadline on the monotonic clock, with nanosecond precision through
+    a timerfd, so a loop that paces its sends never oversleeps a send slot.
+*/
+class EventLoop
+{
+public:
+  typedef std::function<void(uint32_t events)> Callback;
+
+  EventLoop();
+  ~EventLoop();
+  EventLoop(const EventLoop&) = delete;
+
+  void add(int fd, uint32_t events, Callback callback);
+  void modify(int fd, uint32_t events);
+
+  //! runs the callbacks for whatever is ready, waiting until 'deadline' at most (ns)
+  void poll(int64_t deadline);
+
+  //! epoll and timerfd calls so far
+  uint64_t syscalls() const
+  {
+    return d_syscalls;
+  }
+
+private:
+  int d_epfd;
+  int d_timerfd;
+  int64_t d_armed{0}; //<! when the timerfd goes off, 0 if it is not armed
+  uint64_t d_syscalls{0};
+  std::vector<Callback> d_callbacks; //<! indexed by fd
+  std::vector<struct epoll_event> d_events;
+};
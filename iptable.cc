@@ -0,0 +1,325 @@
+#include "iptable.hh"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+using namespace std;
+
+IPv4Table::IPv4Table()
+{
+  build({});
+}
+
+IPv4Table::IPv4Table(const vector<IPv4Prefix>& prefixes)
+{
+  build(prefixes);
+}
+
+IPv4Table::IPv4Table(const NetmaskTree<bool>& tree)
+{
+  vector<IPv4Prefix> prefixes;
+  for(const auto& n : tree) {
+    const auto& network = n->first.getNetwork();
+    if(network.sin4.sin_family == AF_INET)
+      prefixes.push_back({ntohl(network.sin4.sin_addr.s_addr), n->first.getBits()});
+  }
+  build(prefixes);
+}
+
+struct IPv4Table::Storage
+{
+  vector<Block> blocks;
+  vector<Leaf> leaves;
+};
+
+void IPv4Table::build(const vector<IPv4Prefix>& prefixes)
+{
+  auto storage = std::make_shared<Storage>();
+  auto& blocks = storage->blocks;
+  auto& leaves = storage->leaves;
+  blocks.assign(s_numBlocks, Block{0, 0, 0, 0});
+
+  map<uint32_t, Leaf> partials; // ordered by /24, which is also the leaf order
+  for(const auto& p : prefixes) {
+    if(p.bits > 32)
+      continue;
+    uint32_t network = p.bits ? p.network & (0xffffffffU << (32 - p.bits)) : 0;
+    if(p.bits <= 24) {
+      uint32_t first = network >> 8, num = 1U << (24 - p.bits);
+      for(uint32_t n = first; n < first + num; ) {
+        if(!(n & 63) && first + num - n >= 64) {
+          blocks[n >> 6].full = ~0ULL;
+          n += 64;
+        }
+        else {
+          blocks[n >> 6].full |= 1ULL << (n & 63);
+          ++n;
+        }
+      }
+    }
+    else {
+      auto& leaf = partials[network >> 8];
+      for(uint32_t a = network & 0xff; a < (network & 0xff) + (1U << (32 - p.bits)); ++a)
+        leaf[a >> 6] |= 1ULL << (a & 63);
+    }
+  }
+
+  for(const auto& p : partials) {
+    Block& b = blocks[p.first >> 6];
+    uint64_t bit = 1ULL << (p.first & 63);
+    if(b.full & bit)
+      continue;
+    b.partial |= bit;
+    leaves.push_back(p.second);
+  }
+
+  uint32_t rank = 0;
+  d_count = 0;
+  for(auto& b : blocks) {
+    b.rank = rank;
+    rank += __builtin_popcountll(b.partial);
+    d_count += 256 * __builtin_popcountll(b.full);
+  }
+  for(const auto& l : leaves)
+    for(auto w : l)
+      d_count += __builtin_popcountll(w);
+
+  d_blocks = blocks.data();
+  d_leaves = leaves.data();
+  d_numLeaves = leaves.size();
+  d_storage = storage;
+}
+
+void IPv4Table::matchBatch(const uint32_t* ips, size_t n, uint8_t* results) const
+{
+  constexpr size_t lookahead = 16;
+  size_t i = 0;
+#ifdef __x86_64__
+  static const bool haveAVX2 = __builtin_cpu_supports("avx2");
+  if(haveAVX2)
+    i = matchBatchAVX2(ips, n, results);
+#endif
+  for(; i < n; ++i) {
+    if(i + lookahead < n)
+      __builtin_prefetch(&d_blocks[ips[i + lookahead] >> 14]);
+    results[i] = match(ips[i]);
+  }
+}
+
+void IPv4Table::matchBitmap(const uint32_t* ips, size_t n, uint64_t* bitmap) const
+{
+  uint8_t results[256];
+  for(size_t i = 0; i < n; i += sizeof(results)) {
+    size_t num = std::min(n - i, sizeof(results));
+    matchBatch(ips + i, num, results);
+    for(size_t j = 0; j < num; j += 64) {
+      uint64_t word = 0;
+      for(size_t k = 0; k < 64 && j + k < num; ++k)
+        word |= (uint64_t)results[j + k] << k;
+      bitmap[(i + j) / 64] = word;
+    }
+  }
+}
+
+vector<pair<uint32_t, uint32_t>> IPv4Table::ranges() const
+{
+  vector<pair<uint32_t, uint32_t>> ret;
+  auto add = [&ret](uint32_t first, uint32_t last) {
+    if(!ret.empty() && ret.back().second + 1 == first)
+      ret.back().second = last;
+    else
+      ret.push_back({first, last});
+  };
+  for(uint32_t n = 0; n < s_numBlocks; ++n) {
+    const Block& b = d_blocks[n];
+    for(uint64_t bits = b.full | b.partial; bits; bits &= bits - 1) {
+      unsigned int pos = __builtin_ctzll(bits);
+      uint32_t net = ((n << 6) | pos) << 8;
+      if((b.full >> pos) & 1) {
+        add(net, net | 0xff);
+        continue;
+      }
+      const Leaf& l = d_leaves[b.rank + __builtin_popcountll(b.partial & ((1ULL << pos) - 1))];
+      for(unsigned int a = 0; a < 256; ++a) {
+        if(!((l[a >> 6] >> (a & 63)) & 1))
+          continue;
+        unsigned int last = a;
+        while(last < 255 && ((l[(last + 1) >> 6] >> ((last + 1) & 63)) & 1))
+          ++last;
+        add(net | a, net | last);
+        a = last;
+      }
+    }
+  }
+  return ret;
+}
+
+#ifdef __x86_64__
+/* Gathers the 'full' and 'partial' words of four blocks at a time, which settles
+   nearly all addresses. The few that land in a partial /24 get a scalar lookup. */
+__attribute__((target("avx2")))
+size_t IPv4Table::matchBatchAVX2(const uint32_t* ips, size_t n, uint8_t* results) const
+{
+  static_assert(sizeof(Block) == 24, "gather below assumes 3 words per Block");
+  constexpr size_t lookahead = 32;
+  const long long* base = reinterpret_cast<const long long*>(d_blocks);
+  const __m256i one = _mm256_set1_epi64x(1), sixtythree = _mm256_set1_epi64x(63);
+  const __m256i zero = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for(; i + 4 <= n; i += 4) {
+    if(i + lookahead + 4 <= n)
+      for(size_t j = 0; j < 4; ++j)
+        __builtin_prefetch(&d_blocks[ips[i + lookahead + j] >> 14]);
+
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ips + i));
+    __m128i block = _mm_srli_epi32(v, 14);
+    __m128i idx = _mm_add_epi32(block, _mm_add_epi32(block, block));
+    __m256i full = _mm256_i32gather_epi64(base, idx, 8);
+    __m256i partial = _mm256_i32gather_epi64(base + 1, idx, 8);
+    __m256i bit = _mm256_sllv_epi64(one, _mm256_and_si256(_mm256_cvtepu32_epi64(_mm_srli_epi32(v, 8)), sixtythree));
+
+    int isFull = 0xf ^ _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(full, bit), zero)));
+    int isPartial = 0xf ^ _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(partial, bit), zero)));
+    isPartial &= ~isFull;
+
+    for(int lane = 0; lane < 4; ++lane)
+      results[i + lane] = (isPartial >> lane) & 1 ? match(ips[i + lane]) : (isFull >> lane) & 1;
+  }
+  return i;
+}
+#endif
+
+namespace {
+/* The snapshot is the header below followed by the blocks and then the leaves, exactly
+   as they are in memory. It is in host byte order, which the magic number catches. */
+struct SnapshotHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t numBlocks;
+  uint64_t numLeaves;
+  uint64_t count;
+  uint64_t checksum; //<! over everything after the header
+  uint64_t pad[2];
+};
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header should be 64 bytes");
+
+const char g_snapshotMagic[8] = {'S', 'O', 'B', 'S', 'C', 'A', 'N', '4'};
+constexpr uint32_t g_snapshotVersion = 1;
+
+// FNV-1a over 64-bit words, the sizes involved are always a multiple of 8
+uint64_t checksum(const void* data, size_t len, uint64_t h = 0xcbf29ce484222325ULL)
+{
+  const uint64_t* p = static_cast<const uint64_t*>(data);
+  for(size_t n = 0; n < len / 8; ++n)
+    h = (h ^ p[n]) * 0x100000001b3ULL;
+  return h;
+}
+
+void writeAll(int fd, const void* data, size_t len, const string& fname)
+{
+  const char* p = static_cast<const char*>(data);
+  while(len) {
+    ssize_t res = ::write(fd, p, len);
+    if(res < 0)
+      throw runtime_error("Writing snapshot '"+fname+"': "+strerror(errno));
+    p += res;
+    len -= res;
+  }
+}
+}
+
+void IPv4Table::save(const string& fname) const
+{
+  SnapshotHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, g_snapshotMagic, sizeof(h.magic));
+  h.version = g_snapshotVersion;
+  h.headerSize = sizeof(h);
+  h.numBlocks = s_numBlocks;
+  h.numLeaves = d_numLeaves;
+  h.count = d_count;
+  h.checksum = checksum(d_leaves, d_numLeaves * sizeof(Leaf), checksum(d_blocks, s_numBlocks * sizeof(Block)));
+
+  // write to a temporary file and rename, so a scan starting meanwhile never sees half a snapshot
+  string tmp = fname + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    throw runtime_error("Creating snapshot '"+tmp+"': "+strerror(errno));
+  try {
+    writeAll(fd, &h, sizeof(h), tmp);
+    writeAll(fd, d_blocks, s_numBlocks * sizeof(Block), tmp);
+    writeAll(fd, d_leaves, d_numLeaves * sizeof(Leaf), tmp);
+  }
+  catch(...) {
+    close(fd);
+    unlink(tmp.c_str());
+    throw;
+  }
+  if(close(fd) < 0 || rename(tmp.c_str(), fname.c_str()) < 0) {
+    unlink(tmp.c_str());
+    throw runtime_error("Writing snapshot '"+fname+"': "+strerror(errno));
+  }
+}
+
+IPv4Table IPv4Table::load(const string& fname)
+{
+  int fd = open(fname.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw runtime_error("Opening snapshot '"+fname+"': "+strerror(errno));
+  struct stat st;
+  if(fstat(fd, &st) < 0) {
+    close(fd);
+    throw runtime_error("Opening snapshot '"+fname+"': "+strerror(errno));
+  }
+  size_t len = st.st_size;
+  if(len < sizeof(SnapshotHeader)) {
+    close(fd);
+    throw runtime_error("Snapshot '"+fname+"' is truncated");
+  }
+  void* addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED)
+    throw runtime_error("Mapping snapshot '"+fname+"': "+strerror(errno));
+
+  IPv4Table ret{Unbuilt()};
+  ret.d_storage = std::shared_ptr<const void>(addr, [len](const void* p) { munmap(const_cast<void*>(p), len); });
+
+  const SnapshotHeader* h = static_cast<const SnapshotHeader*>(addr);
+  if(memcmp(h->magic, g_snapshotMagic, sizeof(h->magic)))
+    throw runtime_error("'"+fname+"' is not a prefix snapshot");
+  if(h->version != g_snapshotVersion || h->headerSize != sizeof(SnapshotHeader) || h->numBlocks != s_numBlocks)
+    throw runtime_error("Snapshot '"+fname+"' has version "+to_string(h->version)+", need "+to_string(g_snapshotVersion)+", please recompile it");
+  if(len != sizeof(SnapshotHeader) + s_numBlocks * sizeof(Block) + h->numLeaves * sizeof(Leaf))
+    throw runtime_error("Snapshot '"+fname+"' has the wrong size");
+
+  const char* body = static_cast<const char*>(addr) + sizeof(SnapshotHeader);
+  if(checksum(body, len - sizeof(SnapshotHeader)) != h->checksum)
+    throw runtime_error("Snapshot '"+fname+"' is damaged, checksum mismatch");
+
+  ret.d_blocks = reinterpret_cast<const Block*>(body);
+  ret.d_leaves = reinterpret_cast<const Leaf*>(body + s_numBlocks * sizeof(Block));
+  ret.d_numLeaves = h->numLeaves;
+  ret.d_count = h->count;
+  return ret;
+}
+
+bool IPv4Table::isSnapshot(const string& fname)
+{
+  char magic[sizeof(g_snapshotMagic)];
+  int fd = open(fname.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+  bool ret = read(fd, magic, sizeof(magic)) == sizeof(magic) && !memcmp(magic, g_snapshotMagic, sizeof(magic));
+  close(fd);
+  return ret;
+}
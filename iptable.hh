@@ -0,0 +1,105 @@
+#pragma once
+#include "netmask.hh"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! An IPv4 prefix, network in host byte order
+struct IPv4Prefix
+{
+  uint32_t network;
+  uint8_t bits;
+};
+
+/** Read-only, build-once IPv4 prefix membership table.
+
+    Every /24 has two bits: 'full' if it is covered by a prefix of /24 or shorter,
+    'partial' if only longer prefixes cover parts of it. The bits of 64 consecutive /24s
+    are stored together with a running count of partial /24s, which indexes a 256-bit
+    leaf for the individual addresses.
+
+    This means most lookups are a single memory access, and addresses within partial
+    /24s take two. The table is around 6MB, no matter how many prefixes went in.
+
+    save() writes the table as a snapshot file, which load() maps straight into memory
+    so it can be used without any parsing. Copies of a table share the same storage.
+*/
+class IPv4Table
+{
+public:
+  IPv4Table();
+  explicit IPv4Table(const std::vector<IPv4Prefix>& prefixes);
+  explicit IPv4Table(const NetmaskTree<bool>& tree);
+
+  //<! writes a snapshot, throws on error
+  void save(const std::string& fname) const;
+  //<! maps a snapshot written by save(), throws if it is damaged or from another version
+  static IPv4Table load(const std::string& fname);
+  //<! true if fname starts like a snapshot
+  static bool isSnapshot(const std::string& fname);
+
+  //<! ip in host byte order
+  bool match(uint32_t ip) const
+  {
+    const Block& b = d_blocks[ip >> 14];
+    uint64_t bit = 1ULL << ((ip >> 8) & 63);
+    if(b.full & bit)
+      return true;
+    if(!(b.partial & bit))
+      return false;
+    const Leaf& l = d_leaves[b.rank + __builtin_popcountll(b.partial & (bit - 1))];
+    return (l[(ip & 0xff) >> 6] >> (ip & 63)) & 1;
+  }
+
+  bool match(const ComboAddress& ca) const
+  {
+    if(ca.sin4.sin_family != AF_INET)
+      return false;
+    return match(ntohl(ca.sin4.sin_addr.s_addr));
+  }
+
+  //<! matches n addresses (host byte order) at once, results[i] becomes 0 or 1
+  void matchBatch(const uint32_t* ips, size_t n, uint8_t* results) const;
+  //<! same, but sets bit i of bitmap, which must have room for n bits
+  void matchBitmap(const uint32_t* ips, size_t n, uint64_t* bitmap) const;
+
+  //<! the covered space as sorted, non-adjacent ranges of first and last address
+  std::vector<std::pair<uint32_t, uint32_t>> ranges() const;
+
+  //<! number of IPv4 addresses covered by the table
+  uint64_t addressCount() const
+  {
+    return d_count;
+  }
+
+private:
+  struct Block
+  {
+    uint64_t full;
+    uint64_t partial;
+    uint32_t rank;  //<! number of partial /24s before this block
+    uint32_t pad;
+  };
+  typedef std::array<uint64_t, 4> Leaf;
+
+  struct Storage;
+  struct Unbuilt {};
+  static constexpr size_t s_numBlocks = 1 << 18;
+
+  explicit IPv4Table(Unbuilt) {}
+
+  void build(const std::vector<IPv4Prefix>& prefixes);
+#ifdef __x86_64__
+  size_t matchBatchAVX2(const uint32_t* ips, size_t n, uint8_t* results) const;
+#endif
+
+  std::shared_ptr<const void> d_storage; //<! owns what d_blocks and d_leaves point to
+  const Block* d_blocks{nullptr}; //<! s_numBlocks of them
+  const Leaf* d_leaves{nullptr};
+  size_t d_numLeaves{0};
+  uint64_t d_count{0};
+};
@@ -0,0 +1,113 @@
+#include "ipv6sample.hh"
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+//! all ones below bit 'bits'
+IPv6Address lowMask(unsigned int bits)
+{
+  return bits >= 128 ? ~(IPv6Address)0 : ((IPv6Address)1 << bits) - 1;
+}
+
+//! u / 2^64 of the way into [0, n), n may be anything up to 2^128 - 1
+IPv6Address scaled(uint64_t u, IPv6Address n)
+{
+  return (IPv6Address)u * (uint64_t)(n >> 64) + (((IPv6Address)u * (uint64_t)n) >> 64);
+}
+}
+
+IPv6PrefixSet::IPv6PrefixSet(const vector<IPv6Prefix>& prefixes)
+{
+  d_ranges.reserve(prefixes.size());
+  for(const auto& p : prefixes) {
+    if(p.bits > 128)
+      continue;
+    IPv6Address mask = lowMask(128 - p.bits), first = toIPv6Address(p) & ~mask;
+    d_ranges.push_back({first, first | mask});
+  }
+  sort(d_ranges.begin(), d_ranges.end());
+  size_t out = 0;
+  for(size_t n = 0; n < d_ranges.size(); ++n) {
+    if(out && (d_ranges[out - 1].second == ~(IPv6Address)0 || d_ranges[out - 1].second + 1 >= d_ranges[n].first))
+      d_ranges[out - 1].second = std::max(d_ranges[out - 1].second, d_ranges[n].second);
+    else
+      d_ranges[out++] = d_ranges[n];
+  }
+  d_ranges.resize(out);
+}
+
+bool IPv6PrefixSet::contains(IPv6Address ip) const
+{
+  auto iter = upper_bound(d_ranges.begin(), d_ranges.end(), ip, [](IPv6Address ip, const Range& r) {
+      return ip < r.first;
+    });
+  return iter != d_ranges.begin() && ip <= (iter - 1)->second;
+}
+
+IPv6Sampler::IPv6Sampler(const IPv6PrefixSet& announced, unsigned int unitBits, Weighting weighting, unsigned int iidBits) :
+  d_announced(announced), d_shift(128 - std::min(std::max(unitBits, 1U), 128U)), d_weighting(weighting), d_iidBits(iidBits)
+{
+  IPv6Address weight = 0;
+  for(const auto& r : announced.ranges()) {
+    IPv6Address first = r.first >> d_shift, last = r.second >> d_shift;
+    // a unit shared with the previous range was counted there already
+    if(!d_last.empty() && first == d_last.back()) {
+      if(first == last)
+        continue;
+      ++first;
+    }
+    weight += weighting == Weighting::Unit ? last - first + 1 : 1;
+    d_first.push_back(first);
+    d_last.push_back(last);
+    d_before.push_back(weight);
+  }
+  if(d_first.empty())
+    throw runtime_error("No announced IPv6 space to sample from");
+}
+
+void IPv6Sampler::seedPatterns(const vector<IPv6Prefix>& hitlist)
+{
+  for(const auto& p : hitlist)
+    d_patterns.push_back(toIPv6Address(p) & lowMask(d_shift));
+}
+
+IPv6Address IPv6Sampler::pick(uint64_t u, std::mt19937_64& gen) const
+{
+  IPv6Address k = scaled(u, units());
+  size_t n = upper_bound(d_before.begin(), d_before.end(), k) - d_before.begin();
+  IPv6Address unit = d_first[n];
+  if(d_weighting == Weighting::Unit)
+    unit += k - (n ? d_before[n - 1] : 0);
+  else
+    unit += scaled(gen(), d_last[n] - d_first[n] + 1);
+  return inside(unit, gen);
+}
+
+IPv6Address IPv6Sampler::inside(IPv6Address unit, std::mt19937_64& gen) const
+{
+  IPv6Address base = unit << d_shift, offset = 0;
+  if(!d_patterns.empty())
+    offset = d_patterns[gen() % d_patterns.size()];
+  else if(unsigned int bits = std::min(d_iidBits, d_shift))
+    offset = 1 + scaled(gen(), lowMask(bits));
+  IPv6Address ip = base | offset;
+  if(d_announced.contains(ip))
+    return ip;
+
+  // uniform over the announced parts of the unit, which may lie in several ranges
+  IPv6Address end = base | lowMask(d_shift), total = 0;
+  const auto& ranges = d_announced.ranges();
+  auto begin = lower_bound(ranges.begin(), ranges.end(), base, [](const IPv6PrefixSet::Range& r, IPv6Address ip) {
+      return r.second < ip;
+    });
+  for(auto iter = begin; iter != ranges.end() && iter->first <= end; ++iter)
+    total += std::min(iter->second, end) - std::max(iter->first, base) + 1;
+  IPv6Address k = scaled(gen(), total);
+  for(auto iter = begin; ; ++iter) {
+    IPv6Address first = std::max(iter->first, base), size = std::min(iter->second, end) - first + 1;
+    if(k < size)
+      return first + k;
+    k -= size;
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "prefixfile.hh"
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+//! An IPv6 address as a number, so address arithmetic is plain arithmetic
+typedef unsigned __int128 IPv6Address;
+
+inline IPv6Address toIPv6Address(const IPv6Prefix& p)
+{
+  return (IPv6Address)p.hi << 64 | p.lo;
+}
+
+/** Announced IPv6 space, as a sorted list of disjoint, non-adjacent ranges. Lookups are
+    a binary search over one flat array. */
+class IPv6PrefixSet
+{
+public:
+  typedef std::pair<IPv6Address, IPv6Address> Range; //<! first and last address
+
+  explicit IPv6PrefixSet(const std::vector<IPv6Prefix>& prefixes);
+
+  bool contains(IPv6Address ip) const;
+
+  const std::vector<Range>& ranges() const
+  {
+    return d_ranges;
+  }
+
+private:
+  std::vector<Range> d_ranges;
+};
+
+/** Picks IPv6 addresses to probe from announced space.
+
+    Drawing from 2^128 addresses finds nothing, so this first draws a unit, a /48 by
+    default, and then an address inside it. Units are either all equally likely, or
+    every announced range is equally likely and then every unit inside it.
+
+    Inside a unit, the address is a low interface identifier by default: all bits below
+    the unit zero, except for the last 'iidBits', which are random and not all zero. With
+    a hitlist, the bits below the unit are copied from a random hitlist address instead,
+    so the patterns actually in use, like ::1 or ::53 in subnet 0, are probed. Where a
+    unit is only partly announced, addresses outside the announced part are replaced by
+    a random announced one in that unit, from whichever ranges it shares in.
+*/
+class IPv6Sampler
+{
+public:
+  enum class Weighting { Unit, Range };
+
+  //! unitBits between 1 and 128
+  IPv6Sampler(const IPv6PrefixSet& announced, unsigned int unitBits, Weighting weighting, unsigned int iidBits = 8);
+
+  //! copies the bits below the unit from these addresses from now on
+  void seedPatterns(const std::vector<IPv6Prefix>& hitlist);
+
+  //! u chooses the unit, from the whole of [0, 2^64), gen the address inside it
+  IPv6Address pick(uint64_t u, std::mt19937_64& gen) const;
+
+  //! units in the announced space, that is what pick() chooses from
+  IPv6Address units() const
+  {
+    return d_before.empty() ? 0 : d_before.back();
+  }
+
+private:
+  IPv6Address inside(IPv6Address unit, std::mt19937_64& gen) const;
+
+  IPv6PrefixSet d_announced;
+  std::vector<IPv6Address> d_first;  //<! first unit of each range, less one it shares with the range before
+  std::vector<IPv6Address> d_last;   //<! last unit of each range
+  std::vector<IPv6Address> d_before; //<! weight of the ranges up to and including this one
+  unsigned int d_shift; //<! 128 - unitBits
+  Weighting d_weighting;
+  unsigned int d_iidBits;
+  std::vector<IPv6Address> d_patterns; //<! bits below the unit, from the hitlist
+};
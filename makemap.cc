@@ -1,54 +1,270 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
-#include <random>
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+#include <getopt.h>
 #include "common.hh"
+#include "prefixfile.hh"
 using namespace std;
 
-int main(int argc, char**argv)
+/* Counts per /16 how many of its /24s are announced, where a /24 counts if its first
+   address is. The result is a flat 256x256 array, indexed by the first two octets. */
+
+// walks the ranges, so the cost is in the number of ranges, not in the size of the space
+vector<uint32_t> coverageFromRanges(const PrefixSet& announced)
 {
-  if(argc != 2) {
-    cout<<"Syntax: makemap prefixesfile\n";
-    return EXIT_FAILURE;
+  vector<uint32_t> plot(65536);
+  for(const auto& r : announced.ranges()) {
+    // the /24s that start inside this range
+    uint32_t first = (r.first + 255ULL) >> 8, last = r.last >> 8;
+    while(first <= last) {
+      uint32_t end = std::min(last, first | 0xff);
+      plot[first >> 8] += end - first + 1;
+      first = end + 1;
+    }
   }
-  NetmaskTree<bool> table;
-  loadNetmaskTree(argv[1], table);
-  
-  cout<<"\rHave "<<table.size()<<" netmasks"<<endl;
-  
-  vector<vector<int>> plot;
-  plot.resize(256);
-  for(auto& c : plot)
-    c.resize(256);
-
-  uint32_t numAnnounced=0;
-  ComboAddress ca;
-  ca.sin4.sin_family=AF_INET;
-  
-  uint8_t* ptr = (uint8_t*)&ca.sin4.sin_addr.s_addr;
-  ptr[3]=0;
-  for(int a=0; a < 256; ++a) {
-    ptr[0]=a;
-
-    for(int b=0; b < 256; ++b) {
-      ptr[1]=b;
-      for(int c=0; c < 256; ++c) {
-        ptr[2]=c;
-        if(table.match(ca)) {
-          plot[a][b]++;
-          numAnnounced += 256;
+  return plot;
+}
+
+// looks up every /24, one /8 per task, spread over all cores
+vector<uint32_t> coverageBruteForce(const IPv4Table& table)
+{
+  vector<uint32_t> plot(65536);
+  unsigned int numThreads = std::max(1U, std::thread::hardware_concurrency());
+  vector<std::thread> workers;
+  for(unsigned int t = 0; t < numThreads; ++t) {
+    workers.emplace_back([&table, &plot, t, numThreads]() {
+        vector<uint32_t> ips(65536);
+        vector<uint8_t> announced(ips.size());
+        for(uint32_t a = t; a < 256; a += numThreads) {
+          for(uint32_t bc = 0; bc < 65536; ++bc)
+            ips[bc] = (a << 24) | (bc << 8);
+          table.matchBatch(ips.data(), ips.size(), announced.data());
+          for(uint32_t bc = 0; bc < 65536; ++bc)
+            plot[(a << 8) | (bc >> 8)] += announced[bc];
         }
-      }
+      });
+  }
+  for(auto& w : workers)
+    w.join();
+  return plot;
+}
+
+/* The Hilbert curve keeps addresses that are close together close together on the
+   map, and every prefix ends up as a square or a rectangle of two squares. With order n
+   the map is 2^n pixels wide, and every pixel covers 2^(32-2n) addresses. */
+
+/* Calls f(x, y) for every point along the curve, in order. Each level splits a square
+   into four quadrants, which are visited swapped or mirrored so the curve stays
+   connected. Doing this for all points at once is much cheaper than working out the
+   position of every point on its own. */
+template<typename F>
+void walkHilbert(unsigned int level, uint32_t x, uint32_t y, uint32_t swapped, uint32_t flipped, F& f)
+{
+  if(!level) {
+    f(x, y);
+    return;
+  }
+  --level;
+  for(uint32_t q = 0; q < 4; ++q) {
+    uint32_t rx = q >> 1, ry = (q ^ rx) & 1;
+    if(swapped)
+      std::swap(rx, ry);
+    walkHilbert(level, x | (rx ^ flipped) << level, y | (ry ^ flipped) << level, swapped ^ (q == 0 || q == 3), flipped ^ (q == 3), f);
+  }
+}
+
+//! announced addresses per pixel, in curve order
+vector<uint32_t> pixelCoverage(const PrefixSet& announced, unsigned int order)
+{
+  unsigned int shift = 32 - 2 * order;
+  vector<uint32_t> covered(1ULL << (2 * order));
+  for(const auto& r : announced.ranges()) {
+    for(uint64_t pixel = r.first >> shift; pixel <= r.last >> shift; ++pixel) {
+      uint64_t first = std::max<uint64_t>(r.first, pixel << shift), last = std::min<uint64_t>(r.last, ((pixel + 1) << shift) - 1);
+      covered[pixel] += last - first + 1;
     }
   }
-  cout<<"\r"<<numAnnounced<<" IPv4 addresses announced ("<< 100.0*numAnnounced/std::numeric_limits<uint32_t>::max()<<"%)"<<endl;
+  return covered;
+}
+
+enum Marks : uint8_t { Responder = 1, OpenResolver = 2 };
+
+// marks pixels with responses from a dnsscan --results log, in curve order
+vector<uint8_t> readResults(const string& fname, unsigned int order)
+{
+  bool gzipped = fname.size() > 3 && !fname.compare(fname.size() - 3, 3, ".gz");
+  FILE* fp;
+  if(gzipped) {
+    string quoted;
+    for(char c : fname)
+      quoted += c == '\'' ? string("'\\''") : string(1, c);
+    fp = popen(("gzip -dc '" + quoted + "'").c_str(), "r");
+  }
+  else
+    fp = fopen(fname.c_str(), "r");
+  if(!fp)
+    throw runtime_error("Unable to open results log '"+fname+"': "+strerror(errno));
 
-  cout<<"Writing data to file 'denso'"<<endl;
-  ofstream denso("denso");
-  for(int a=0; a < 256; ++a) {
-    for(int b=0; b < 256; ++b) {
-      denso << a << '\t' << b << '\t' << plot[a][b] << '\n';
+  vector<uint8_t> marks(1ULL << (2 * order));
+  char* line = nullptr;
+  size_t size = 0;
+  uint64_t responses = 0;
+  // time ip id method result rcode aa tc ra open rtt_us
+  while(getline(&line, &size, fp) > 0) {
+    vector<char*> fields;
+    for(char* p = line; ; ++p) {
+      fields.push_back(p);
+      p = strpbrk(p, "\t\n");
+      if(!p || *p == '\n')
+        break;
     }
+    if(fields.size() < 10 || strncmp(fields[4], "response\t", 9))
+      continue;
+    IPv4Prefix ip;
+    const char* p = fields[1];
+    if(!parseIPv4Prefix(p, fields[2] - 1, ip) || ip.bits != 32)
+      continue;
+    marks[ip.network >> (32 - 2 * order)] |= fields[9][0] == '1' ? (Responder | OpenResolver) : Responder;
+    ++responses;
   }
+  free(line);
+  if(gzipped)
+    pclose(fp);
+  else
+    fclose(fp);
+  cout<<"Read "<<responses<<" responses from '"<<fname<<"'"<<endl;
+  return marks;
 }
 
+/* Binary PGM, announced space in shades of grey by how much of a pixel is announced. With
+   results it becomes a PPM, where responders are green and open resolvers red, on a
+   dimmer background. The whole image is built in memory and written at once. */
+void writeImage(const string& fname, unsigned int order, const vector<uint32_t>& covered, const vector<uint8_t>* marks)
+{
+  uint32_t side = 1U << order, channels = marks ? 3 : 1;
+  double pixelSize = 1ULL << (32 - 2 * order);
+  string image = string(marks ? "P6\n" : "P5\n") + to_string(side) + " " + to_string(side) + "\n255\n";
+  size_t header = image.size();
+  image.resize(header + (size_t)side * side * channels);
+  uint8_t* out = (uint8_t*)&image[header];
+  uint32_t d = 0;
+  auto draw = [&](uint32_t x, uint32_t y) {
+    uint8_t* pixel = out + ((size_t)y * side + x) * channels;
+    if(!marks)
+      pixel[0] = 255.0 * covered[d] / pixelSize + 0.5;
+    else if((*marks)[d] & OpenResolver)
+      pixel[0] = 255;
+    else if((*marks)[d] & Responder)
+      pixel[1] = 255;
+    else
+      pixel[0] = pixel[1] = pixel[2] = 96.0 * covered[d] / pixelSize + 0.5;
+    ++d;
+  };
+  walkHilbert(order, 0, 0, 0, 0, draw);
+
+  ofstream file(fname, ios::binary);
+  if(!file.write(image.c_str(), image.size()) || !file.flush())
+    throw runtime_error("Unable to write image to '"+fname+"': "+strerror(errno));
+}
+
+int main(int argc, char**argv)
+{
+  bool bruteForce = false, check = false;
+  string imageFile, resultsFile;
+  unsigned int order = 12;
+  static const struct option longopts[] = {
+    {"brute-force", no_argument, 0, 'b'},
+    {"check", no_argument, 0, 'c'},
+    {"image", required_argument, 0, 'i'},
+    {"order", required_argument, 0, 'o'},
+    {"results", required_argument, 0, 'r'},
+    {0, 0, 0, 0}
+  };
+  for(int c; (c = getopt_long(argc, argv, "bci:o:r:", longopts, 0)) != -1; ) {
+    switch(c) {
+    case 'b':
+      bruteForce=true;
+      break;
+    case 'c':
+      check=true;
+      break;
+    case 'i':
+      imageFile=optarg;
+      break;
+    case 'o':
+      order=atoi(optarg);
+      if(order < 1 || order > 12) {
+        cerr<<"Hilbert curve order must be between 1 and 12"<<endl;
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'r':
+      resultsFile=optarg;
+      break;
+    default:
+      return EXIT_FAILURE;
+    }
+  }
+  if(argc - optind != 1) {
+    cout<<"Syntax: makemap [--brute-force] [--check] [--image file [--order n] [--results log]] prefixesfile|snapshot\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    // a snapshot only has the lookup table, which can give the ranges too
+    IPv4Table table;
+    PrefixSet announced;
+    if(IPv4Table::isSnapshot(argv[optind])) {
+      table = IPv4Table::load(argv[optind]);
+      announced = PrefixSet(table);
+    }
+    else {
+      announced = PrefixSet(loadIPv4Prefixes(argv[optind]));
+      if(bruteForce || check)
+        table = IPv4Table(announced.prefixes());
+    }
+    cout<<"Have "<<announced.ranges().size()<<" distinct ranges, "<<announced.addressCount()<<" IPv4 addresses ("<<100.0*announced.addressCount()/4294967296.0<<"%)"<<endl;
+
+    vector<uint32_t> plot = bruteForce ? coverageBruteForce(table) : coverageFromRanges(announced);
+    if(check) {
+      auto other = bruteForce ? coverageFromRanges(announced) : coverageBruteForce(table);
+      unsigned int mismatches = 0;
+      for(unsigned int n = 0; n < plot.size(); ++n)
+        if(plot[n] != other[n])
+          ++mismatches;
+      cout<<"Range walk and brute force "<<(mismatches ? "disagree on "+to_string(mismatches)+" /16s" : "agree")<<endl;
+      if(mismatches)
+        return EXIT_FAILURE;
+    }
+
+    uint64_t numAnnounced = 0;
+    for(auto count : plot)
+      numAnnounced += 256 * count;
+    cout<<numAnnounced<<" IPv4 addresses in announced /24s ("<< 100.0*numAnnounced/4294967296.0<<"%)"<<endl;
+
+    cout<<"Writing data to file 'denso'"<<endl;
+    string denso;
+    for(int a=0; a < 256; ++a) {
+      for(int b=0; b < 256; ++b) {
+        denso += to_string(a) + '\t' + to_string(b) + '\t' + to_string(plot[(a << 8) | b]) + '\n';
+      }
+    }
+    ofstream("denso").write(denso.c_str(), denso.size());
+
+    if(!imageFile.empty()) {
+      vector<uint8_t> marks;
+      if(!resultsFile.empty())
+        marks = readResults(resultsFile, order);
+      uint32_t side = 1U << order;
+      cout<<"Writing "<<side<<"x"<<side<<" Hilbert map, "<<(1ULL << (32 - 2 * order))<<" addresses per pixel, to '"<<imageFile<<"'"<<endl;
+      writeImage(imageFile, order, pixelCoverage(announced, order), resultsFile.empty() ? nullptr : &marks);
+    }
+  }
+  catch(std::exception& e) {
+    cerr<<"Error: "<<e.what()<<endl;
+    return EXIT_FAILURE;
+  }
+}
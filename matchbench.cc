@@ -0,0 +1,72 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "common.hh"
+using namespace std;
+
+// benchmarks IPv4Table against NetmaskTree<bool> on random addresses, and checks they agree
+
+template<typename F>
+double timeIt(F f)
+{
+  auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char**argv)
+{
+  if(argc != 2 && argc != 3) {
+    cout<<"Syntax: matchbench prefixesfile [lookups]\n";
+    return EXIT_FAILURE;
+  }
+  unsigned int num = argc == 3 ? atoi(argv[2]) : 10000000;
+
+  NetmaskTree<bool> tree;
+  double secs = timeIt([&]() { loadNetmaskTree(argv[1], tree); });
+  cout<<"Loaded "<<tree.size()<<" netmasks into NetmaskTree in "<<secs<<"s"<<endl;
+
+  IPv4Table table;
+  secs = timeIt([&]() { table = IPv4Table(tree); });
+  cout<<"Built IPv4Table in "<<secs<<"s, "<<table.addressCount()<<" addresses"<<endl;
+
+  std::mt19937 gen{1};
+  vector<uint32_t> ips(num);
+  vector<ComboAddress> cas(num);
+  for(unsigned int n = 0; n < num; ++n) {
+    ips[n] = gen();
+    cas[n].sin4.sin_family = AF_INET;
+    cas[n].sin4.sin_addr.s_addr = htonl(ips[n]);
+  }
+
+  vector<uint8_t> treeres(num), tableres(num);
+  secs = timeIt([&]() {
+      for(unsigned int n = 0; n < num; ++n)
+        treeres[n] = tree.match(cas[n]);
+    });
+  cout<<"NetmaskTree: "<<1e9*secs/num<<" ns/lookup"<<endl;
+
+  secs = timeIt([&]() {
+      for(unsigned int n = 0; n < num; ++n)
+        tableres[n] = table.match(ips[n]);
+    });
+  cout<<"IPv4Table:   "<<1e9*secs/num<<" ns/lookup"<<endl;
+
+  vector<uint8_t> batchres(num);
+  secs = timeIt([&]() { table.matchBatch(ips.data(), num, batchres.data()); });
+  cout<<"matchBatch:  "<<1e9*secs/num<<" ns/lookup"<<endl;
+
+  vector<uint64_t> bitmap((num + 63) / 64);
+  secs = timeIt([&]() { table.matchBitmap(ips.data(), num, bitmap.data()); });
+  cout<<"matchBitmap: "<<1e9*secs/num<<" ns/lookup"<<endl;
+
+  unsigned int matches = 0, mismatches = 0;
+  for(unsigned int n = 0; n < num; ++n) {
+    matches += tableres[n];
+    if(treeres[n] != tableres[n] || treeres[n] != batchres[n] || treeres[n] != ((bitmap[n / 64] >> (n % 64)) & 1))
+      ++mismatches;
+  }
+  cout<<matches<<" of "<<num<<" matched ("<<100.0*matches/num<<"%), "<<mismatches<<" mismatches"<<endl;
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
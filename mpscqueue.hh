@@ -0,0 +1,76 @@
+#pragma once
+#include "cacheline.hh"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/** Bounded lock-free queue for many producers and a single consumer, after Dmitry
+    Vyukov's bounded MPMC queue. Every cell carries a sequence number that tells
+    producers and the consumer whose turn it is, so a push is one CAS on the tail and
+    a pop touches no shared counter at all.
+
+    When the queue is full, push() fails instead of waiting, so producers on a hot path
+    never block.
+*/
+template<typename T>
+class MPSCQueue
+{
+public:
+  //! capacity is rounded up to a power of two
+  explicit MPSCQueue(size_t capacity)
+  {
+    size_t size = 2;
+    while(size < capacity)
+      size *= 2;
+    d_mask = size - 1;
+    d_cells.reset(new Cell[size]);
+    for(size_t n = 0; n < size; ++n)
+      d_cells[n].seq.store(n, std::memory_order_relaxed);
+  }
+
+  bool push(const T& item)
+  {
+    size_t pos = d_tail.load(std::memory_order_relaxed);
+    for(;;) {
+      Cell& c = d_cells[pos & d_mask];
+      size_t seq = c.seq.load(std::memory_order_acquire);
+      if(seq == pos) {
+        if(d_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.item = item;
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if(seq < pos)
+        return false; // full
+      else
+        pos = d_tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  //! only ever call from one thread
+  bool pop(T& item)
+  {
+    Cell& c = d_cells[d_head & d_mask];
+    if(c.seq.load(std::memory_order_acquire) != d_head + 1)
+      return false;
+    item = c.item;
+    c.seq.store(d_head + d_mask + 1, std::memory_order_release);
+    ++d_head;
+    return true;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> seq;
+    T item;
+  };
+  std::unique_ptr<Cell[]> d_cells;
+  size_t d_mask;
+  CacheLinePad<> d_pad0;
+  std::atomic<size_t> d_tail{0}; //<! producers
+  CacheLinePad<sizeof(std::atomic<size_t>)> d_pad1;
+  size_t d_head{0}; //<! consumer
+  CacheLinePad<sizeof(size_t)> d_pad2;
+};
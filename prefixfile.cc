@@ -0,0 +1,285 @@
+#include "prefixfile.hh"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+constexpr size_t g_maxExamples = 5;
+constexpr size_t g_minChunk = 1 << 20; //<! smaller files are not worth a thread
+
+bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+int hexValue(char c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+//<! up to 'digits' decimal digits, no larger than max
+bool parseDecimal(const char*& p, const char* end, unsigned int digits, unsigned int max, unsigned int& value)
+{
+  const char* start = p;
+  value = 0;
+  while(p < end && isDigit(*p) && p - start < (ptrdiff_t)digits)
+    value = 10 * value + (*p++ - '0');
+  return p != start && value <= max && !(p < end && isDigit(*p));
+}
+
+bool parseIPv4Address(const char*& p, const char* end, uint32_t& ip)
+{
+  ip = 0;
+  for(int n = 0; n < 4; ++n) {
+    unsigned int octet;
+    if(n && (p == end || *p++ != '.'))
+      return false;
+    if(!parseDecimal(p, end, 3, 255, octet))
+      return false;
+    ip = (ip << 8) | octet;
+  }
+  return true;
+}
+
+//<! an optional '/bits', absent means a host route
+bool parseBits(const char*& p, const char* end, unsigned int max, uint8_t& bits)
+{
+  if(p == end || *p != '/') {
+    bits = max;
+    return true;
+  }
+  ++p;
+  unsigned int value;
+  if(!parseDecimal(p, end, 3, max, value))
+    return false;
+  bits = value;
+  return true;
+}
+
+bool startsWith(const char* p, const char* end, const char* prefix)
+{
+  size_t len = strlen(prefix);
+  return (size_t)(end - p) >= len && !memcmp(p, prefix, len);
+}
+
+struct ChunkResult
+{
+  vector<IPv4Prefix> v4;
+  vector<IPv6Prefix> v6;
+  PrefixFileStats stats;
+};
+
+void parseChunk(const char* p, const char* end, bool wantV4, bool wantV6, ChunkResult& res)
+{
+  auto& stats = res.stats;
+  while(p < end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if(!eol)
+      eol = end;
+    const char* line = p, *lend = eol;
+    p = eol + 1;
+    ++stats.lines;
+    if(lend > line && lend[-1] == '\r')
+      --lend;
+
+    // blank lines, comments, and what birdc prints around and between routes
+    if(line == lend || *line == ' ' || *line == '\t' || *line == '#' || *line == ';' ||
+       startsWith(line, lend, "BIRD ") || startsWith(line, lend, "Table ") || startsWith(line, lend, "Access restricted")) {
+      ++stats.skipped;
+      continue;
+    }
+
+    const char* token = line;
+    while(token < lend && *token != ' ' && *token != '\t' && *token != ';')
+      ++token;
+    bool ok;
+    const char* q = line;
+    if(memchr(line, ':', token - line)) {
+      IPv6Prefix prefix;
+      ok = parseIPv6Prefix(q, token, prefix) && q == token;
+      if(ok && !prefix.bits)
+        ++stats.defaults;
+      else if(ok) {
+        ++stats.v6;
+        if(wantV6)
+          res.v6.push_back(prefix);
+      }
+    }
+    else {
+      IPv4Prefix prefix;
+      ok = parseIPv4Prefix(q, token, prefix) && q == token;
+      if(ok && !prefix.bits)
+        ++stats.defaults;
+      else if(ok) {
+        ++stats.v4;
+        if(wantV4)
+          res.v4.push_back(prefix);
+      }
+    }
+    if(!ok) {
+      ++stats.malformed;
+      if(stats.examples.size() < g_maxExamples)
+        stats.examples.emplace_back(stats.lines, string(line, lend));
+    }
+  }
+}
+}
+
+bool parseIPv4Prefix(const char*& p, const char* end, IPv4Prefix& prefix)
+{
+  uint32_t ip;
+  if(!parseIPv4Address(p, end, ip) || !parseBits(p, end, 32, prefix.bits))
+    return false;
+  prefix.network = prefix.bits ? ip & (0xffffffffU << (32 - prefix.bits)) : 0;
+  return true;
+}
+
+bool parseIPv6Prefix(const char*& p, const char* end, IPv6Prefix& prefix)
+{
+  uint16_t groups[8];
+  int num = 0, gap = -1; // gap is where '::' goes
+  if(end - p >= 2 && p[0] == ':' && p[1] == ':') {
+    gap = 0;
+    p += 2;
+  }
+  while(p < end && num < 8 && hexValue(*p) >= 0) {
+    const char* start = p;
+    unsigned int value = 0;
+    while(p < end && hexValue(*p) >= 0 && p - start < 4)
+      value = (value << 4) | hexValue(*p++);
+    if(p < end && *p == '.') { // trailing dotted quad
+      uint32_t ip;
+      p = start;
+      if(num > 6 || !parseIPv4Address(p, end, ip))
+        return false;
+      groups[num++] = ip >> 16;
+      groups[num++] = ip & 0xffff;
+      break;
+    }
+    if(p < end && hexValue(*p) >= 0)
+      return false;
+    groups[num++] = value;
+    if(end - p >= 2 && p[0] == ':' && p[1] == ':') {
+      if(gap >= 0)
+        return false;
+      gap = num;
+      p += 2;
+    }
+    else if(p < end && *p == ':') {
+      ++p;
+      if(p == end || hexValue(*p) < 0)
+        return false;
+    }
+    else
+      break;
+  }
+  if(gap < 0 ? num != 8 : num > 7)
+    return false;
+
+  uint16_t full[8] = {0};
+  if(gap < 0)
+    memcpy(full, groups, sizeof(full));
+  else {
+    std::copy(groups, groups + gap, full);
+    std::copy(groups + gap, groups + num, full + 8 - (num - gap));
+  }
+  prefix.hi = prefix.lo = 0;
+  for(int n = 0; n < 4; ++n) {
+    prefix.hi = (prefix.hi << 16) | full[n];
+    prefix.lo = (prefix.lo << 16) | full[n + 4];
+  }
+
+  if(!parseBits(p, end, 128, prefix.bits))
+    return false;
+  if(prefix.bits <= 64) {
+    prefix.hi = prefix.bits ? prefix.hi & (~0ULL << (64 - prefix.bits)) : 0;
+    prefix.lo = 0;
+  }
+  else if(prefix.bits < 128)
+    prefix.lo &= ~0ULL << (128 - prefix.bits);
+  return true;
+}
+
+PrefixFileStats parsePrefixFile(const string& fname, vector<IPv4Prefix>* v4, vector<IPv6Prefix>* v6, unsigned int threads)
+{
+  int fd = open(fname.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw runtime_error("Opening prefixes file '"+fname+"': "+strerror(errno));
+  struct stat st;
+  if(fstat(fd, &st) < 0) {
+    close(fd);
+    throw runtime_error("Opening prefixes file '"+fname+"': "+strerror(errno));
+  }
+  size_t len = st.st_size;
+  if(!len) {
+    close(fd);
+    return PrefixFileStats();
+  }
+  void* addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED)
+    throw runtime_error("Mapping prefixes file '"+fname+"': "+strerror(errno));
+  madvise(addr, len, MADV_SEQUENTIAL);
+  const char* data = static_cast<const char*>(addr);
+
+  if(!threads)
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  size_t numChunks = std::max((size_t)1, std::min((size_t)threads, len / g_minChunk));
+
+  // every chunk starts right after a newline, so no line is split
+  vector<size_t> bounds(numChunks + 1, len);
+  bounds[0] = 0;
+  for(size_t n = 1; n < numChunks; ++n) {
+    size_t pos = std::max(bounds[n - 1], n * len / numChunks);
+    const char* nl = pos < len ? static_cast<const char*>(memchr(data + pos, '\n', len - pos)) : nullptr;
+    bounds[n] = nl ? nl - data + 1 : len;
+  }
+
+  vector<ChunkResult> results(numChunks);
+  vector<std::thread> workers;
+  for(size_t n = 1; n < numChunks; ++n)
+    workers.emplace_back(parseChunk, data + bounds[n], data + bounds[n + 1], v4 != nullptr, v6 != nullptr, std::ref(results[n]));
+  parseChunk(data + bounds[0], data + bounds[1], v4 != nullptr, v6 != nullptr, results[0]);
+  for(auto& w : workers)
+    w.join();
+  munmap(addr, len);
+
+  PrefixFileStats ret;
+  size_t total4 = 0, total6 = 0;
+  for(const auto& r : results) {
+    total4 += r.v4.size();
+    total6 += r.v6.size();
+  }
+  if(v4)
+    v4->reserve(v4->size() + total4);
+  if(v6)
+    v6->reserve(v6->size() + total6);
+  for(const auto& r : results) {
+    if(v4)
+      v4->insert(v4->end(), r.v4.begin(), r.v4.end());
+    if(v6)
+      v6->insert(v6->end(), r.v6.begin(), r.v6.end());
+    for(const auto& e : r.stats.examples)
+      if(ret.examples.size() < g_maxExamples)
+        ret.examples.emplace_back(ret.lines + e.first, e.second);
+    ret.lines += r.stats.lines;
+    ret.v4 += r.stats.v4;
+    ret.v6 += r.stats.v6;
+    ret.defaults += r.stats.defaults;
+    ret.skipped += r.stats.skipped;
+    ret.malformed += r.stats.malformed;
+  }
+  return ret;
+}
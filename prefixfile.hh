@@ -0,0 +1,39 @@
+#pragma once
+#include "iptable.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//! An IPv6 prefix, network as two host byte order halves
+struct IPv6Prefix
+{
+  uint64_t hi, lo;
+  uint8_t bits;
+};
+
+//<! parses 'a.b.c.d' or 'a.b.c.d/bits' from [p, end), moves p past it. Host bits are cleared
+bool parseIPv4Prefix(const char*& p, const char* end, IPv4Prefix& prefix);
+//<! same for IPv6, including :: and a trailing dotted quad
+bool parseIPv6Prefix(const char*& p, const char* end, IPv6Prefix& prefix);
+
+//! What was in a prefixes file, besides the prefixes
+struct PrefixFileStats
+{
+  uint64_t lines{0};
+  uint64_t v4{0}, v6{0};
+  uint64_t defaults{0}; //<! 0.0.0.0/0 and ::/0, which are left out
+  uint64_t skipped{0};  //<! empty, comment, birdc header and continuation lines
+  uint64_t malformed{0};
+  //! the first few malformed lines, with their line numbers
+  std::vector<std::pair<uint64_t, std::string>> examples;
+};
+
+/** Reads a file with one prefix per line, or the output of 'birdc show route', where
+    everything after the prefix is ignored.
+
+    The file is mapped and cut into chunks on line boundaries, which are parsed by up
+    to 'threads' threads (0 for one per core). Prefixes come out in file order, either
+    vector may be null if that family is not needed. Throws if the file can't be read.
+*/
+PrefixFileStats parsePrefixFile(const std::string& fname, std::vector<IPv4Prefix>* v4, std::vector<IPv6Prefix>* v6, unsigned int threads = 0);
@@ -0,0 +1,148 @@
+#include "prefixset.hh"
+#include <algorithm>
+using namespace std;
+
+namespace {
+// sorts and merges overlapping and adjacent ranges
+void normalize(vector<PrefixSet::Range>& ranges)
+{
+  sort(ranges.begin(), ranges.end(), [](const PrefixSet::Range& a, const PrefixSet::Range& b) {
+      return a.first < b.first;
+    });
+  size_t out = 0;
+  for(size_t n = 0; n < ranges.size(); ++n) {
+    if(out && (uint64_t)ranges[out - 1].last + 1 >= ranges[n].first)
+      ranges[out - 1].last = std::max(ranges[out - 1].last, ranges[n].last);
+    else
+      ranges[out++] = ranges[n];
+  }
+  ranges.resize(out);
+}
+}
+
+PrefixSet::PrefixSet(vector<Range>&& ranges) : d_ranges(std::move(ranges))
+{
+  d_before.reserve(d_ranges.size());
+  for(const auto& r : d_ranges) {
+    d_before.push_back(d_count);
+    d_count += r.size();
+  }
+  if(!d_count)
+    return;
+  // about one bucket per range is plenty, small sets should not carry a big index
+  uint64_t maxBuckets = std::min((size_t)1 << s_indexBits, d_ranges.size());
+  while((d_count - 1) >> d_shift >= maxBuckets)
+    ++d_shift;
+  uint64_t buckets = ((d_count - 1) >> d_shift) + 1;
+  d_index.reserve(buckets + 1);
+  size_t n = 0;
+  for(uint64_t b = 0; b < buckets; ++b) {
+    while(d_before[n] + d_ranges[n].size() <= (b << d_shift))
+      ++n;
+    d_index.push_back(n);
+  }
+  d_index.push_back(d_ranges.size() - 1);
+}
+
+PrefixSet::PrefixSet(const IPv4Table& table)
+{
+  vector<Range> ranges;
+  for(const auto& r : table.ranges())
+    ranges.push_back({r.first, r.second});
+  *this = PrefixSet(std::move(ranges));
+}
+
+PrefixSet::PrefixSet(const vector<IPv4Prefix>& prefixes)
+{
+  vector<Range> ranges;
+  ranges.reserve(prefixes.size());
+  for(const auto& p : prefixes) {
+    if(p.bits > 32)
+      continue;
+    uint32_t mask = p.bits ? 0xffffffffU << (32 - p.bits) : 0;
+    ranges.push_back({p.network & mask, (p.network & mask) | ~mask});
+  }
+  *this = fromRanges(std::move(ranges));
+}
+
+PrefixSet PrefixSet::fromRanges(vector<Range> ranges)
+{
+  ranges.erase(remove_if(ranges.begin(), ranges.end(), [](const Range& r) { return r.first > r.last; }), ranges.end());
+  normalize(ranges);
+  return PrefixSet(std::move(ranges));
+}
+
+PrefixSet PrefixSet::unite(const PrefixSet& rhs) const
+{
+  vector<Range> ranges;
+  ranges.reserve(d_ranges.size() + rhs.d_ranges.size());
+  auto a = d_ranges.begin(), b = rhs.d_ranges.begin();
+  while(a != d_ranges.end() || b != rhs.d_ranges.end()) {
+    const Range& r = (b == rhs.d_ranges.end() || (a != d_ranges.end() && a->first < b->first)) ? *a++ : *b++;
+    if(!ranges.empty() && (uint64_t)ranges.back().last + 1 >= r.first)
+      ranges.back().last = std::max(ranges.back().last, r.last);
+    else
+      ranges.push_back(r);
+  }
+  return PrefixSet(std::move(ranges));
+}
+
+PrefixSet PrefixSet::intersect(const PrefixSet& rhs) const
+{
+  vector<Range> ranges;
+  auto a = d_ranges.begin(), b = rhs.d_ranges.begin();
+  while(a != d_ranges.end() && b != rhs.d_ranges.end()) {
+    uint32_t first = std::max(a->first, b->first), last = std::min(a->last, b->last);
+    if(first <= last)
+      ranges.push_back({first, last});
+    if(a->last < b->last)
+      ++a;
+    else
+      ++b;
+  }
+  return PrefixSet(std::move(ranges));
+}
+
+PrefixSet PrefixSet::subtract(const PrefixSet& rhs) const
+{
+  vector<Range> ranges;
+  auto b = rhs.d_ranges.begin();
+  for(const auto& r : d_ranges) {
+    uint64_t first = r.first; // 64 bits, since it may move past 0xffffffff
+    while(b != rhs.d_ranges.end() && b->last < first)
+      ++b;
+    for(auto c = b; c != rhs.d_ranges.end() && c->first <= r.last; ++c) {
+      if(c->first > first)
+        ranges.push_back({(uint32_t)first, c->first - 1});
+      first = (uint64_t)c->last + 1;
+    }
+    if(first <= r.last)
+      ranges.push_back({(uint32_t)first, r.last});
+  }
+  return PrefixSet(std::move(ranges));
+}
+
+bool PrefixSet::contains(uint32_t ip) const
+{
+  auto iter = upper_bound(d_ranges.begin(), d_ranges.end(), ip, [](uint32_t ip, const Range& r) {
+      return ip < r.first;
+    });
+  return iter != d_ranges.begin() && ip <= (iter - 1)->last;
+}
+
+vector<IPv4Prefix> PrefixSet::prefixes() const
+{
+  vector<IPv4Prefix> ret;
+  for(const auto& r : d_ranges) {
+    uint64_t first = r.first, end = (uint64_t)r.last + 1;
+    while(first < end) {
+      // the largest aligned block that starts here and still fits
+      unsigned int size = first ? __builtin_ctzll(first) : 32;
+      while((1ULL << size) > end - first)
+        --size;
+      ret.push_back({(uint32_t)first, (uint8_t)(32 - size)});
+      first += 1ULL << size;
+    }
+  }
+  return ret;
+}
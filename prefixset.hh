@@ -0,0 +1,87 @@
+#pragma once
+#include "iptable.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** A set of IPv4 addresses, kept as a sorted list of disjoint, non-adjacent ranges.
+
+    However many more-specifics and overlaps went in, this is the minimal description
+    of the space they cover. Every range also knows how many addresses come before it,
+    so counting is exact and cheap.
+
+    Sets are immutable, and union, intersection and difference make new ones in a
+    single pass over both. prefixes() turns a set back into the fewest CIDR prefixes,
+    for instance to build an IPv4Table from.
+
+    at(k) finds the k-th address of the set. A coarse index on the address count
+    narrows this down to a few ranges, which are then binary searched.
+*/
+class PrefixSet
+{
+public:
+  //! first and last are both in the range, host byte order
+  struct Range
+  {
+    uint32_t first, last;
+    uint64_t size() const
+    {
+      return (uint64_t)last - first + 1;
+    }
+  };
+
+  PrefixSet() {}
+  explicit PrefixSet(const std::vector<IPv4Prefix>& prefixes);
+  explicit PrefixSet(const IPv4Table& table);
+  //<! ranges may overlap and come in any order
+  static PrefixSet fromRanges(std::vector<Range> ranges);
+
+  PrefixSet unite(const PrefixSet& rhs) const;
+  PrefixSet intersect(const PrefixSet& rhs) const;
+  PrefixSet subtract(const PrefixSet& rhs) const;
+
+  bool contains(uint32_t ip) const;
+
+  //<! address k of the set, in order, k < addressCount()
+  uint32_t at(uint64_t k) const
+  {
+    uint64_t bucket = k >> d_shift;
+    auto begin = d_before.begin() + d_index[bucket], end = d_before.begin() + d_index[bucket + 1] + 1;
+    size_t n = std::upper_bound(begin, end, k) - d_before.begin() - 1;
+    return d_ranges[n].first + (uint32_t)(k - d_before[n]);
+  }
+
+  //<! the fewest prefixes that cover exactly this set
+  std::vector<IPv4Prefix> prefixes() const;
+
+  const std::vector<Range>& ranges() const
+  {
+    return d_ranges;
+  }
+  //<! number of addresses in ranges before range n
+  uint64_t addressesBefore(size_t n) const
+  {
+    return d_before[n];
+  }
+  uint64_t addressCount() const
+  {
+    return d_count;
+  }
+  bool empty() const
+  {
+    return d_ranges.empty();
+  }
+
+private:
+  //<! ranges must be sorted, disjoint and non-adjacent already
+  explicit PrefixSet(std::vector<Range>&& ranges);
+
+  static constexpr unsigned int s_indexBits = 12;
+
+  std::vector<Range> d_ranges;
+  std::vector<uint64_t> d_before;
+  std::vector<uint32_t> d_index; //<! range holding address (n << d_shift), plus the last range at the end
+  unsigned int d_shift{0};
+  uint64_t d_count{0};
+};
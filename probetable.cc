@@ -0,0 +1,108 @@
+#include "probetable.hh"
+using namespace std;
+
+ProbeTable::ProbeTable(size_t capacity)
+{
+  unsigned int bits = 4;
+  while((1ULL << bits) < capacity)
+    ++bits;
+  d_mask = (1ULL << bits) - 1;
+  d_shift = 64 - bits;
+  d_slots.reset(new Slot[d_mask + 1]);
+  for(size_t n = 0; n <= d_mask; ++n) {
+    d_slots[n].word.store(0, memory_order_relaxed);
+    d_slots[n].sent.store(0, memory_order_relaxed);
+  }
+}
+
+bool ProbeTable::insert(uint32_t ip, uint16_t id, int64_t sent, uint8_t tag)
+{
+  uint64_t key = ((uint64_t)ip << 16) | id;
+  size_t pos = slotOf(key);
+  for(size_t tries = 0; tries <= d_mask; ++tries, pos = (pos + 1) & d_mask) {
+    Slot& s = d_slots[pos];
+    uint64_t word = s.word.load(memory_order_relaxed);
+    if(stateOf(word) != Empty)
+      continue;
+    if(!s.word.compare_exchange_strong(word, makeWord(key, tag, Claimed), memory_order_acquire))
+      continue; // somebody else got it first
+    s.sent.store(sent, memory_order_relaxed);
+    s.word.store(makeWord(key, tag, Outstanding), memory_order_release);
+    return true;
+  }
+  return false;
+}
+
+ProbeTable::Answer ProbeTable::answer(uint32_t ip, uint16_t id, int64_t now, int64_t* rtt, uint8_t* tag)
+{
+  uint64_t key = ((uint64_t)ip << 16) | id;
+  size_t pos = slotOf(key);
+  // the same key may have been used for more than one probe
+  bool answered = false, expired = false;
+  for(size_t tries = 0; tries <= d_mask; ++tries, pos = (pos + 1) & d_mask) {
+    Slot& s = d_slots[pos];
+    uint64_t word = s.word.load(memory_order_acquire);
+    while(stateOf(word) == Claimed) // an insert is in progress, which takes nanoseconds
+      word = s.word.load(memory_order_acquire);
+    if(stateOf(word) == Empty)
+      break;
+    if(keyOf(word) != key)
+      continue;
+    if(stateOf(word) == Outstanding &&
+       s.word.compare_exchange_strong(word, makeWord(key, tagOf(word), Answered), memory_order_acq_rel)) {
+      *rtt = now - s.sent.load(memory_order_relaxed);
+      *tag = tagOf(word);
+      return Answer::First;
+    }
+    *tag = tagOf(word);
+    if(stateOf(word) == Expired)
+      expired = true;
+    else
+      answered = true;
+  }
+  if(answered)
+    return Answer::Duplicate;
+  return expired ? Answer::Late : Answer::Unsolicited;
+}
+
+ProbeTable::Answer ProbeTable::peek(uint32_t ip, uint16_t id, uint8_t* tag) const
+{
+  uint64_t key = ((uint64_t)ip << 16) | id;
+  size_t pos = slotOf(key);
+  bool answered = false, expired = false;
+  for(size_t tries = 0; tries <= d_mask; ++tries, pos = (pos + 1) & d_mask) {
+    uint64_t word = d_slots[pos].word.load(memory_order_acquire);
+    while(stateOf(word) == Claimed)
+      word = d_slots[pos].word.load(memory_order_acquire);
+    if(stateOf(word) == Empty)
+      break;
+    if(keyOf(word) != key)
+      continue;
+    *tag = tagOf(word);
+    if(stateOf(word) == Outstanding)
+      return Answer::First;
+    if(stateOf(word) == Expired)
+      expired = true;
+    else
+      answered = true;
+  }
+  if(answered)
+    return Answer::Duplicate;
+  return expired ? Answer::Late : Answer::Unsolicited;
+}
+
+bool ProbeTable::expire(uint32_t ip, uint16_t id)
+{
+  uint64_t key = ((uint64_t)ip << 16) | id;
+  size_t pos = slotOf(key);
+  for(size_t tries = 0; tries <= d_mask; ++tries, pos = (pos + 1) & d_mask) {
+    Slot& s = d_slots[pos];
+    uint64_t word = s.word.load(memory_order_acquire);
+    if(stateOf(word) == Empty)
+      break;
+    if(keyOf(word) == key && stateOf(word) == Outstanding &&
+       s.word.compare_exchange_strong(word, makeWord(key, tagOf(word), Expired), memory_order_acq_rel))
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/** Table of outstanding probes keyed by (target IPv4 address, DNS ID), which senders
+    insert into and receivers look up in concurrently, without locks.
+
+    It uses open addressing with linear probing. Every slot is an atomic key word, which
+    also holds the probe state and a small tag, plus the send timestamp. A slot is claimed
+    with a CAS, filled in, and then published with a release store, so readers never see
+    half-written entries.
+
+    Answered and expired probes stay in the table, so repeated answers are recognized
+    as duplicates and answers after the timeout as late. Responses for which there is
+    no entry are unsolicited. As slots are never freed, the table must be sized for
+    every probe of a scan, not just the ones in flight.
+*/
+class ProbeTable
+{
+public:
+  //! capacity is rounded up to a power of two, and should be well above the number of probes in the whole scan
+  explicit ProbeTable(size_t capacity);
+
+  //! ip in host byte order, sent is a timestamp in ns. Returns false if the table is full
+  bool insert(uint32_t ip, uint16_t id, int64_t sent, uint8_t tag = 0);
+
+  enum class Answer { Unsolicited, First, Duplicate, Late };
+  //! marks a probe as answered at 'now'. rtt is only filled in for the first answer, tag unless unsolicited
+  Answer answer(uint32_t ip, uint16_t id, int64_t now, int64_t* rtt, uint8_t* tag);
+  //! what answer() would say now, without marking anything, so a packet can be checked first
+  Answer peek(uint32_t ip, uint16_t id, uint8_t* tag) const;
+
+  //! gives up on an outstanding probe, returns false if it was answered already
+  bool expire(uint32_t ip, uint16_t id);
+
+  size_t capacity() const
+  {
+    return d_mask + 1;
+  }
+
+private:
+  enum State : uint64_t { Empty = 0, Claimed = 1, Outstanding = 2, Answered = 3, Expired = 4 };
+  static uint64_t makeWord(uint64_t key, uint8_t tag, State state)
+  {
+    return key | ((uint64_t)tag << 48) | ((uint64_t)state << 56);
+  }
+  static uint64_t keyOf(uint64_t word)
+  {
+    return word & 0xffffffffffffULL;
+  }
+  static State stateOf(uint64_t word)
+  {
+    return (State)(word >> 56);
+  }
+  static uint8_t tagOf(uint64_t word)
+  {
+    return (word >> 48) & 0xff;
+  }
+  size_t slotOf(uint64_t key) const
+  {
+    return (key * 0x9E3779B97F4A7C15ULL) >> d_shift;
+  }
+
+  struct Slot
+  {
+    std::atomic<uint64_t> word;
+    std::atomic<int64_t> sent;
+  };
+  std::unique_ptr<Slot[]> d_slots;
+  size_t d_mask;
+  unsigned int d_shift;
+};
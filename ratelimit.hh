@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//! nanoseconds on the monotonic clock
+inline int64_t monotonicNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Token bucket on the monotonic clock, which may be shared by any number of threads.
+
+    It works as a 'virtual schedule' (GCRA): tryTake() claims the next n slots of 1/rate
+    seconds each if the last of them has come up, and fails otherwise. After being idle,
+    up to 'burst' tokens are available at once, so n must not be more than that. The shared state is a single atomic
+    timestamp, so there is no lock on the send path, and nothing waits in here: callers
+    that get no tokens wait until nextAvailable() in their own event loop.
+*/
+class TokenBucket
+{
+public:
+  //! a rate of 0 means no limit
+  TokenBucket(double rate, double burst) :
+    d_interval(rate > 0 ? 1e9 / rate : 0),
+    d_tau(rate > 0 ? (std::max(burst, 1.0) - 1) * d_interval : 0),
+    d_tat(0)
+  {}
+
+  //! takes n tokens if they are available right now
+  bool tryTake(unsigned int n = 1)
+  {
+    if(!d_interval)
+      return true;
+    int64_t t = monotonicNs(), tat = d_tat.load(std::memory_order_relaxed);
+    for(;;) {
+      int64_t start = std::max(tat, t - (int64_t)d_tau);
+      if(start + (int64_t)((n - 1) * d_interval) > t)
+        return false;
+      if(d_tat.compare_exchange_weak(tat, start + (int64_t)(n * d_interval), std::memory_order_relaxed))
+        return true;
+    }
+  }
+
+  //! monotonic ns from which tryTake(n) succeeds again, unless somebody else gets there first
+  int64_t nextAvailable(unsigned int n = 1) const
+  {
+    return d_tat.load(std::memory_order_relaxed) + (int64_t)((n - 1) * d_interval);
+  }
+
+private:
+  const double d_interval; //<! ns per token
+  const double d_tau;      //<! ns of credit a full bucket holds
+  std::atomic<int64_t> d_tat; //<! theoretical arrival time of the next token
+};
@@ -0,0 +1,94 @@
+#include "rawprobe.hh"
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cstring>
+using namespace std;
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+ProbeCookie::Value ProbeCookie::make(uint32_t ip, uint8_t tag, unsigned int worker, uint64_t epoch) const
+{
+  uint64_t h = mix(d_secret ^ (((uint64_t)tag << 32) | ip));
+  Value ret;
+  ret.port = s_firstPort + (h & 0x7fff) / d_workers * d_workers + worker;
+  if(ret.port < s_firstPort) // the last partial round of ports would wrap
+    ret.port -= d_workers;
+  ret.id = ((h >> 16) & ~s_epochMask) | (epoch & s_epochMask);
+  ret.slot = h >> 32;
+  return ret;
+}
+
+// one's complement sum, not yet folded
+static uint32_t checksumAdd(uint32_t sum, const unsigned char* data, size_t len)
+{
+  for(; len > 1; data += 2, len -= 2)
+    sum += (data[0] << 8) | data[1];
+  if(len)
+    sum += data[0] << 8;
+  return sum;
+}
+
+static void putShort(char* p, uint16_t v)
+{
+  p[0] = v >> 8;
+  p[1] = v & 0xff;
+}
+
+static void putLong(char* p, uint32_t v)
+{
+  putShort(p, v >> 16);
+  putShort(p + 2, v & 0xffff);
+}
+
+void writeUDPHeaders(char* packet, uint32_t src, uint32_t dst, uint16_t sport, uint16_t dport, size_t len)
+{
+  char* ip = packet;
+  memset(ip, 0, 20);
+  ip[0] = 0x45;
+  putShort(ip + 2, 20 + 8 + len);
+  putShort(ip + 6, 0x4000); // don't fragment
+  ip[8] = 64;
+  ip[9] = IPPROTO_UDP;
+  putLong(ip + 12, src);
+  putLong(ip + 16, dst);
+
+  char* udp = packet + 20;
+  putShort(udp, sport);
+  putShort(udp + 2, dport);
+  putShort(udp + 4, 8 + len);
+  putShort(udp + 6, 0);
+  // over the pseudo header, UDP header and payload
+  uint32_t sum = (src >> 16) + (src & 0xffff) + (dst >> 16) + (dst & 0xffff) + IPPROTO_UDP + 8 + len;
+  sum = checksumAdd(sum, (const unsigned char*)udp, 8 + len);
+  while(sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  uint16_t check = ~sum;
+  putShort(udp + 6, check ? check : 0xffff); // 0 would mean no checksum
+}
+
+bool parseUDPPacket(const char* packet, size_t len, UDPPacket& out)
+{
+  const unsigned char* p = (const unsigned char*)packet;
+  if(len < 20 || (p[0] >> 4) != 4 || p[9] != IPPROTO_UDP)
+    return false;
+  size_t ihl = (p[0] & 0x0f) * 4, total = (p[2] << 8) | p[3];
+  if(ihl < 20 || total > len || total < ihl + 8 || (((p[6] << 8) | p[7]) & 0x3fff)) // fragments
+    return false;
+  const unsigned char* udp = p + ihl;
+  size_t udplen = (udp[4] << 8) | udp[5];
+  if(udplen < 8 || udplen > total - ihl)
+    return false;
+  out.src = ((uint32_t)p[12] << 24) | (p[13] << 16) | (p[14] << 8) | p[15];
+  out.dst = ((uint32_t)p[16] << 24) | (p[17] << 16) | (p[18] << 8) | p[19];
+  out.sport = (udp[0] << 8) | udp[1];
+  out.dport = (udp[2] << 8) | udp[3];
+  out.payload = (const char*)udp + 8;
+  out.len = udplen - 8;
+  return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/** Cookies for stateless probing. A keyed hash of the target and the probe tag picks the
+    source port and the DNS ID of a probe, so an answer can be checked against the
+    address it came from without remembering anything per probe.
+
+    Source ports are 32768 and up, split between the workers: the worker that sent a probe
+    is the port minus 32768, modulo the number of workers. The low bits of the ID are not
+    hashed, but say in which epoch the probe went out, so its answer can be counted
+    together with it. That leaves 15 bits of the port, less the worker bits, and 13 bits
+    of the ID to check an answer against.
+*/
+class ProbeCookie
+{
+public:
+  struct Value
+  {
+    uint16_t port, id;
+    uint32_t slot; //<! other bits of the hash, to recognize answers already seen
+  };
+
+  ProbeCookie(uint64_t secret, unsigned int workers) : d_secret(secret), d_workers(workers)
+  {}
+
+  //! only the low s_epochBits of epoch go in the ID
+  Value make(uint32_t ip, uint8_t tag, unsigned int worker, uint64_t epoch = 0) const;
+  //<! the worker that sent probes from this port, or -1 if no probe uses it
+  int worker(uint16_t port) const
+  {
+    return port >= s_firstPort ? (int)((port - s_firstPort) % d_workers) : -1;
+  }
+
+  static constexpr uint16_t s_firstPort = 32768;
+  static constexpr unsigned int s_epochBits = 3;
+  static constexpr uint16_t s_epochMask = (1 << s_epochBits) - 1;
+
+private:
+  uint64_t d_secret;
+  unsigned int d_workers;
+};
+
+//! IPv4 header without options, plus UDP header
+constexpr size_t g_udpHeaders = 28;
+
+/** Writes IPv4 and UDP headers for the payload of 'len' bytes that is already at
+    packet + g_udpHeaders, for sending over a raw socket with IP_HDRINCL. The kernel fills
+    in the IP ID and checksum, we do the UDP checksum. Addresses in host byte order. */
+void writeUDPHeaders(char* packet, uint32_t src, uint32_t dst, uint16_t sport, uint16_t dport, size_t len);
+
+//! A UDP datagram as read from a raw socket, addresses and ports in host byte order
+struct UDPPacket
+{
+  uint32_t src, dst;
+  uint16_t sport, dport;
+  const char* payload;
+  size_t len;
+};
+
+//! false if packet is not a complete, unfragmented IPv4 UDP datagram
+bool parseUDPPacket(const char* packet, size_t len, UDPPacket& out);
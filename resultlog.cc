@@ -0,0 +1,151 @@
+#include "resultlog.hh"
+#include "ratelimit.hh"
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+const char* g_kinds[] = {"response", "timeout", "late", "duplicate", "unsolicited", "malformed"};
+constexpr size_t g_chunk = 1 << 20;
+
+void appendNum(string& out, uint64_t n)
+{
+  char buf[20];
+  int pos = sizeof(buf);
+  do {
+    buf[--pos] = '0' + n % 10;
+    n /= 10;
+  } while(n);
+  out.append(buf + pos, sizeof(buf) - pos);
+}
+}
+
+ResultLog::ResultLog(const std::string& fname, const char* const* tagNames) : d_queue(1 << 16), d_tagNames(tagNames)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  d_wallOffset = ts.tv_sec * 1000000000LL + ts.tv_nsec - monotonicNs();
+
+  d_pipe = fname.size() > 3 && !fname.compare(fname.size() - 3, 3, ".gz");
+  if(d_pipe) {
+    string quoted;
+    for(char c : fname)
+      quoted += c == '\'' ? string("'\\''") : string(1, c);
+    signal(SIGPIPE, SIG_IGN); // so a gzip that goes away shows up as a write error
+    d_fp = popen(("gzip -c > '" + quoted + "'").c_str(), "w");
+  }
+  else
+    d_fp = fopen(fname.c_str(), "w");
+  if(!d_fp)
+    throw runtime_error("Unable to open results log '"+fname+"': "+strerror(errno));
+
+  d_buffer.reserve(g_chunk + 256);
+  d_buffer = "time\tip\tid\tmethod\tresult\trcode\taa\ttc\tra\topen\trtt_us\n";
+  d_writer = std::thread(&ResultLog::writerThread, this);
+}
+
+ResultLog::~ResultLog()
+{
+  try {
+    close();
+  }
+  catch(std::exception&) {
+    // nobody to tell from here, main closes the log itself
+  }
+}
+
+void ResultLog::close()
+{
+  if(!d_fp)
+    return;
+  d_stop = true;
+  d_writer.join();
+  flush();
+  FILE* fp = d_fp;
+  d_fp = nullptr;
+  string error;
+  if(ferror(fp))
+    error = "Writing the results log failed";
+  if(d_pipe) {
+    int status = pclose(fp);
+    if(status < 0)
+      error = string("Closing results log: ")+strerror(errno);
+    else if(status)
+      error = "Compressing the results log failed, gzip exited with status "+to_string(WIFEXITED(status) ? WEXITSTATUS(status) : status);
+  }
+  else if(fclose(fp))
+    error = string("Closing results log: ")+strerror(errno);
+  if(!error.empty())
+    throw runtime_error(error+", it is incomplete"+(d_dropped ? " and "+to_string(d_dropped)+" records were lost" : ""));
+}
+
+void ResultLog::writerThread()
+{
+  ProbeResult r;
+  int64_t lastFlush = monotonicNs();
+  for(;;) {
+    bool stopping = d_stop; // read first, so nothing pushed before the stop gets lost
+    unsigned int num = 0;
+    while(d_queue.pop(r)) {
+      format(r);
+      if(d_buffer.size() >= g_chunk)
+        flush();
+      ++num;
+    }
+    if(stopping)
+      break;
+    if(!num) {
+      if(monotonicNs() - lastFlush > 1000000000) { // when it is quiet, do write out what we have
+        flush();
+        fflush(d_fp);
+        lastFlush = monotonicNs();
+      }
+      usleep(1000);
+    }
+  }
+}
+
+void ResultLog::format(const ProbeResult& r)
+{
+  int64_t wall = r.when + d_wallOffset;
+  appendNum(d_buffer, wall / 1000000000);
+  d_buffer += '.';
+  char frac[10];
+  snprintf(frac, sizeof(frac), "%06u", (unsigned int)(wall % 1000000000 / 1000));
+  d_buffer += frac;
+  d_buffer += '\t';
+  for(int shift = 24; shift >= 0; shift -= 8) {
+    appendNum(d_buffer, (r.ip >> shift) & 0xff);
+    d_buffer += shift ? '.' : '\t';
+  }
+  appendNum(d_buffer, r.id);
+  d_buffer += '\t';
+  d_buffer += r.tag == ProbeResult::NoTag ? "-" : d_tagNames[r.tag];
+  d_buffer += '\t';
+  d_buffer += g_kinds[r.kind];
+  d_buffer += '\t';
+  if(r.kind == ProbeResult::Response) {
+    appendNum(d_buffer, r.rcode);
+    for(uint8_t flag : {ProbeResult::AA, ProbeResult::TC, ProbeResult::RA, ProbeResult::OpenResolver}) {
+      d_buffer += '\t';
+      d_buffer += (r.flags & flag) ? '1' : '0';
+    }
+    d_buffer += '\t';
+    appendNum(d_buffer, r.rtt);
+    d_buffer += '\n';
+  }
+  else
+    d_buffer += "\t\t\t\t\t\n";
+  ++d_buffered;
+}
+
+void ResultLog::flush()
+{
+  if(!d_buffer.empty() && fwrite(d_buffer.c_str(), 1, d_buffer.size(), d_fp) != d_buffer.size())
+    d_dropped += d_buffered; // not much else we can do from here
+  d_buffer.clear();
+  d_buffered = 0;
+}
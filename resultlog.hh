@@ -0,0 +1,71 @@
+#pragma once
+#include "mpscqueue.hh"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+//! One line in the results log
+struct ProbeResult
+{
+  enum Kind : uint8_t { Response, Timeout, Late, Duplicate, Unsolicited, Malformed };
+  enum Flags : uint8_t { AA = 1, TC = 2, RA = 4, OpenResolver = 8 };
+  static constexpr uint8_t NoTag = 0xff; //<! for responses we can't tie to a probe
+
+  int64_t when;  //<! monotonic ns, the log turns this into wall clock time
+  uint32_t ip;   //<! host byte order
+  uint32_t rtt;  //<! us, for responses
+  uint16_t id;
+  uint8_t tag;   //<! which generator the probe came from, index into the tag names
+  Kind kind;
+  uint8_t rcode;
+  uint8_t flags;
+};
+
+/** Per-probe results log, written by a thread of its own so the receive path never
+    waits for I/O. Producers hand over fixed-size records through a lock-free queue.
+    If the writer cannot keep up, records are dropped and counted rather than slowing
+    anybody down.
+
+    The output has one tab separated line per record, with a header line, and is
+    written in large chunks. If the filename ends in .gz it is piped through gzip.
+*/
+class ResultLog
+{
+public:
+  ResultLog(const std::string& fname, const char* const* tagNames);
+  ~ResultLog();
+  ResultLog(const ResultLog&) = delete;
+
+  //! writes out the rest and closes the file, throws if that fails, or if gzip does
+  void close();
+
+  void log(const ProbeResult& r)
+  {
+    if(!d_queue.push(r))
+      ++d_dropped;
+  }
+
+  //! the final count once close() returns
+  uint64_t dropped() const
+  {
+    return d_dropped;
+  }
+
+private:
+  void writerThread();
+  void format(const ProbeResult& r);
+  void flush();
+
+  MPSCQueue<ProbeResult> d_queue;
+  std::atomic<uint64_t> d_dropped{0};
+  std::atomic<bool> d_stop{false};
+  const char* const* d_tagNames;
+  int64_t d_wallOffset; //<! realtime minus monotonic, ns
+  FILE* d_fp;
+  bool d_pipe;
+  std::string d_buffer;
+  uint64_t d_buffered{0}; //<! records in d_buffer
+  std::thread d_writer;
+};
@@ -0,0 +1,102 @@
+#include "sobol.hh"
+#include <random>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+// From new-joe-kuo-6.21201 by S. Joe and F. Y. Kuo, dimensions 2 and up.
+// Dimension 1 is the van der Corput sequence, which has all m_i=1.
+struct DirectionNumbers
+{
+  unsigned int s;     // degree of the primitive polynomial
+  unsigned int a;     // its inner coefficients
+  uint32_t m[7];      // initial direction numbers
+};
+
+const DirectionNumbers g_joekuo[SobolGenerator::MAXDIM - 1] = {
+  {1, 0, {1}},
+  {2, 1, {1, 3}},
+  {3, 1, {1, 3, 1}},
+  {3, 2, {1, 1, 1}},
+  {4, 1, {1, 1, 3, 3}},
+  {4, 4, {1, 3, 5, 13}},
+  {5, 2, {1, 1, 5, 5, 17}},
+  {5, 4, {1, 1, 5, 5, 5}},
+  {5, 7, {1, 1, 7, 11, 19}},
+  {5, 11, {1, 1, 5, 1, 1}},
+  {5, 13, {1, 1, 1, 3, 11}},
+  {5, 14, {1, 3, 5, 5, 31}},
+  {6, 1, {1, 3, 3, 9, 7, 49}},
+  {6, 13, {1, 1, 1, 15, 21, 21}},
+  {6, 16, {1, 3, 1, 13, 27, 49}},
+  {6, 19, {1, 1, 1, 15, 7, 5}},
+  {6, 22, {1, 3, 1, 15, 13, 25}},
+  {6, 25, {1, 1, 5, 5, 19, 61}},
+  {7, 1, {1, 3, 7, 11, 23, 15, 103}},
+  {7, 4, {1, 3, 7, 13, 13, 15, 69}}
+};
+}
+
+SobolGenerator::SobolGenerator(unsigned int dims, uint64_t seed) : d_dims(dims)
+{
+  if(!dims || dims > MAXDIM)
+    throw std::invalid_argument("Sobol dimensions must be between 1 and "+to_string(MAXDIM));
+
+  constexpr unsigned int B = MAXBIT;
+  vector<uint32_t> v(B);
+  d_v.resize(B * d_dims);
+  d_x.assign(d_dims, 0);
+  d_shift.assign(d_dims, 0);
+
+  mt19937_64 gen(seed);
+  for(unsigned int k = 0; k < d_dims; ++k) {
+    if(!k) {
+      for(unsigned int i = 0; i < B; ++i)
+        v[i] = 1U << (B - 1 - i);
+    }
+    else {
+      const auto& dn = g_joekuo[k - 1];
+      for(unsigned int i = 0; i < dn.s; ++i)
+        v[i] = dn.m[i] << (B - 1 - i);
+      for(unsigned int i = dn.s; i < B; ++i) {
+        v[i] = v[i - dn.s] ^ (v[i - dn.s] >> dn.s);
+        for(unsigned int l = 1; l < dn.s; ++l)
+          if((dn.a >> (dn.s - 1 - l)) & 1)
+            v[i] ^= v[i - l];
+      }
+    }
+
+    if(seed) {
+      /* Linear scramble: output digit r is digit r of the input plus a random
+         combination of the more significant digits. Since the map is linear,
+         applying it to the direction numbers scrambles every point. */
+      uint32_t rows[B];
+      for(unsigned int r = 0; r < B; ++r) {
+        uint32_t bit = 1U << (B - 1 - r);
+        rows[r] = bit | (gen() & ~(bit | (bit - 1)));
+      }
+      for(auto& dir : v) {
+        uint32_t out = 0;
+        for(unsigned int r = 0; r < B; ++r)
+          out |= (uint32_t)__builtin_parity(rows[r] & dir) << (B - 1 - r);
+        dir = out;
+      }
+      d_shift[k] = gen();
+    }
+
+    for(unsigned int i = 0; i < B; ++i)
+      d_v[i * d_dims + k] = v[i];
+  }
+}
+
+void SobolGenerator::seek(uint64_t index)
+{
+  d_index = index;
+  uint64_t gray = index ^ (index >> 1);
+  for(unsigned int k = 0; k < d_dims; ++k) {
+    d_x[k] = 0;
+    for(unsigned int i = 0; i < MAXBIT; ++i)
+      if((gray >> i) & 1)
+        d_x[k] ^= d_v[i * d_dims + k];
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/** Sobol low-discrepancy sequence at 32-bit resolution, with the Joe-Kuo direction
+    numbers for up to MAXDIM dimensions.
+
+    Points come out in Gray code order, so each one costs a single XOR per dimension.
+    seek() jumps straight to point k, which allows threads or hosts to each generate a
+    disjoint slice of the same sequence.
+
+    With a non-zero seed the sequence is scrambled with a random linear matrix scramble
+    plus a digital shift. This keeps the net properties, and different seeds give
+    independent replicates of the same scan.
+*/
+class SobolGenerator
+{
+public:
+  static constexpr unsigned int MAXDIM = 21, MAXBIT = 32;
+
+  explicit SobolGenerator(unsigned int dims, uint64_t seed = 0);
+
+  //<! next point will be point 'index'
+  void seek(uint64_t index);
+  uint64_t index() const
+  {
+    return d_index;
+  }
+  unsigned int dims() const
+  {
+    return d_dims;
+  }
+
+  //<! writes dims() coordinates
+  void next(uint32_t* x)
+  {
+    if(d_index >= (1ULL << MAXBIT))
+      throw std::out_of_range("Sobol sequence exhausted");
+    for(unsigned int k = 0; k < d_dims; ++k)
+      x[k] = d_x[k] ^ d_shift[k];
+    ++d_index;
+    unsigned int c = __builtin_ctzll(d_index);
+    if(c < MAXBIT) {
+      const uint32_t* v = &d_v[c * d_dims];
+      for(unsigned int k = 0; k < d_dims; ++k)
+        d_x[k] ^= v[k];
+    }
+  }
+
+  //<! writes n points of dims() coordinates each
+  void fill(uint32_t* x, size_t n)
+  {
+    for(size_t i = 0; i < n; ++i, x += d_dims)
+      next(x);
+  }
+
+private:
+  unsigned int d_dims;
+  uint64_t d_index{0};
+  std::vector<uint32_t> d_v; //<! direction numbers, bit-major so one step touches one row
+  std::vector<uint32_t> d_x;
+  std::vector<uint32_t> d_shift;
+};
@@ -0,0 +1,43 @@
+#include "stats.hh"
+#include <cmath>
+using namespace std;
+
+void LatencyHistogram::addTo(vector<uint64_t>& counts) const
+{
+  for(size_t n = 0; n < s_buckets; ++n)
+    counts[n] += d_counts[n].load(memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucket(int64_t ns)
+{
+  uint64_t us = ns > 0 ? ns / 1000 : 0;
+  if(us < 8)
+    return us;
+  unsigned int octave = 63 - __builtin_clzll(us); // 3 and up
+  size_t n = (octave - 2) * 8 + ((us >> (octave - 3)) & 7);
+  return n < s_buckets ? n : s_buckets - 1;
+}
+
+int64_t LatencyHistogram::upperBound(size_t n)
+{
+  if(n < 8)
+    return (n + 1) * 1000 - 1;
+  unsigned int octave = n / 8 + 2;
+  return ((int64_t)(8 + n % 8 + 1) << (octave - 3)) * 1000 - 1;
+}
+
+int64_t LatencyHistogram::percentile(const vector<uint64_t>& counts, double q)
+{
+  uint64_t total = 0;
+  for(auto c : counts)
+    total += c;
+  if(!total)
+    return 0;
+  uint64_t rank = std::max<uint64_t>(1, ceil(q * total)), seen = 0;
+  for(size_t n = 0; n < counts.size(); ++n) {
+    seen += counts[n];
+    if(seen >= rank)
+      return upperBound(n);
+  }
+  return upperBound(counts.size() - 1);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! for a counter with a single writer: a relaxed load and store instead of a locked add
+inline void bump(std::atomic<uint64_t>& counter, uint64_t n = 1)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/** Latency histogram with one writer and any number of readers, who may see it a few
+    records behind. Buckets are log-linear in microseconds: exact below 8us, and then 8
+    per power of two, so a bucket is at most 12.5% wide. Everything from about two
+    minutes up goes in the last bucket.
+
+    Readers add the buckets of all writers together with addTo(), and take percentiles
+    from the sum.
+*/
+class LatencyHistogram
+{
+public:
+  static constexpr size_t s_buckets = 200;
+
+  void record(int64_t ns)
+  {
+    bump(d_counts[bucket(ns)]);
+  }
+
+  //! counts must have s_buckets entries
+  void addTo(std::vector<uint64_t>& counts) const;
+
+  static size_t bucket(int64_t ns);
+  //! the highest latency that goes in bucket n, in ns
+  static int64_t upperBound(size_t n);
+  //! upper bound of the bucket that holds quantile q of counts, 0 if there is nothing
+  static int64_t percentile(const std::vector<uint64_t>& counts, double q);
+
+private:
+  std::atomic<uint64_t> d_counts[s_buckets]{};
+};
@@ -0,0 +1,257 @@
+#include "stratify.hh"
+#include "prefixfile.hh"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+typedef vector<pair<PrefixSet::Range, uint32_t>> Labeled;
+
+/* Turns labeled prefixes into disjoint ranges, where each range carries the label of
+   the most specific prefix covering it. Since prefixes either nest or don't overlap at
+   all, one pass in address order with a stack of enclosing prefixes does this. */
+Labeled labelMostSpecific(vector<pair<IPv4Prefix, uint32_t>> prefixes)
+{
+  for(auto& p : prefixes)
+    p.first.network &= p.first.bits ? 0xffffffffU << (32 - p.first.bits) : 0;
+  sort(prefixes.begin(), prefixes.end(), [](const pair<IPv4Prefix, uint32_t>& a, const pair<IPv4Prefix, uint32_t>& b) {
+      return a.first.network < b.first.network || (a.first.network == b.first.network && a.first.bits < b.first.bits);
+    });
+  Labeled ret;
+  vector<pair<uint32_t, uint32_t>> stack; // last address and label of enclosing prefixes
+  uint64_t pos = 0; // first address not yet emitted
+  auto emit = [&ret, &pos](uint64_t last, uint32_t label) {
+    if(pos <= last)
+      ret.push_back({{(uint32_t)pos, (uint32_t)last}, label});
+    pos = last + 1;
+  };
+  for(const auto& p : prefixes) {
+    uint32_t first = p.first.network, last = first | (p.first.bits ? ~(0xffffffffU << (32 - p.first.bits)) : 0xffffffffU);
+    while(!stack.empty() && stack.back().first < first) {
+      emit(stack.back().first, stack.back().second);
+      stack.pop_back();
+    }
+    if(!stack.empty() && first)
+      emit((uint64_t)first - 1, stack.back().second);
+    pos = first;
+    stack.push_back({last, p.second});
+  }
+  while(!stack.empty()) {
+    emit(stack.back().first, stack.back().second);
+    stack.pop_back();
+  }
+  return ret;
+}
+
+bool isBlank(char c)
+{
+  return c == ' ' || c == '\t';
+}
+}
+
+Strata::Strata(const Labeled& labeled, const vector<string>& names, const PrefixSet& space)
+{
+  // clip the labeled ranges to the space in one pass, both are sorted
+  vector<vector<PrefixSet::Range>> ranges(names.size());
+  vector<PrefixSet::Range> all;
+  all.reserve(labeled.size());
+  auto s = space.ranges().begin(), send = space.ranges().end();
+  for(const auto& l : labeled) {
+    all.push_back(l.first);
+    while(s != send && s->last < l.first.first)
+      ++s;
+    for(auto t = s; t != send && t->first <= l.first.last; ++t)
+      ranges[l.second].push_back({std::max(t->first, l.first.first), std::min(t->last, l.first.last)});
+  }
+
+  vector<int> index(names.size(), -1);
+  for(size_t n = 0; n < names.size(); ++n) {
+    if(ranges[n].empty())
+      continue;
+    index[n] = d_strata.size();
+    d_strata.push_back({names[n], PrefixSet::fromRanges(std::move(ranges[n]))});
+  }
+  for(const auto& l : labeled)
+    if(index[l.second] >= 0)
+      d_lookup.push_back({l.first, (uint32_t)index[l.second]});
+
+  // whatever no label covers still needs a stratum, or it would never be sampled
+  auto rest = space.subtract(PrefixSet::fromRanges(std::move(all)));
+  if(!rest.empty()) {
+    for(const auto& r : rest.ranges())
+      d_lookup.push_back({r, (uint32_t)d_strata.size()});
+    d_strata.push_back({"other", std::move(rest)});
+    sort(d_lookup.begin(), d_lookup.end(), [](const pair<PrefixSet::Range, uint32_t>& a, const pair<PrefixSet::Range, uint32_t>& b) {
+        return a.first.first < b.first.first;
+      });
+  }
+}
+
+Strata Strata::bySlash8(const PrefixSet& space)
+{
+  Labeled labeled;
+  vector<string> names;
+  for(uint32_t n = 0; n < 256; ++n) {
+    labeled.push_back({{n << 24, (n << 24) | 0xffffff}, n});
+    names.push_back(to_string(n)+".0.0.0/8");
+  }
+  return Strata(labeled, names, space);
+}
+
+Strata Strata::byPrefixLength(const vector<IPv4Prefix>& prefixes, const PrefixSet& space)
+{
+  vector<pair<IPv4Prefix, uint32_t>> withLabels;
+  withLabels.reserve(prefixes.size());
+  for(const auto& p : prefixes)
+    if(p.bits <= 32)
+      withLabels.push_back({p, p.bits});
+  vector<string> names;
+  for(unsigned int n = 0; n <= 32; ++n)
+    names.push_back("/"+to_string(n));
+  return Strata(labelMostSpecific(std::move(withLabels)), names, space);
+}
+
+Strata Strata::byMapping(const string& fname, const PrefixSet& space)
+{
+  ifstream in(fname);
+  if(!in)
+    throw runtime_error("Opening mapping file '"+fname+"': "+strerror(errno));
+
+  vector<pair<IPv4Prefix, uint32_t>> withLabels;
+  map<string, uint32_t> labels;
+  vector<string> names;
+  string line;
+  uint64_t lineno = 0, malformed = 0;
+  while(getline(in, line)) {
+    ++lineno;
+    if(!line.empty() && line.back() == '\r')
+      line.pop_back();
+    // the same lines parsePrefixFile() skips, and IPv6
+    if(line.empty() || isBlank(line[0]) || line[0] == '#' || line[0] == ';' ||
+       !line.compare(0, 5, "BIRD ") || !line.compare(0, 6, "Table ") || !line.compare(0, 17, "Access restricted"))
+      continue;
+    auto tokenEnd = line.find_first_of(" \t");
+    if(line.find(':') < tokenEnd)
+      continue;
+
+    IPv4Prefix prefix;
+    const char* p = line.c_str(), *end = p + line.size();
+    string label;
+    if(parseIPv4Prefix(p, end, prefix) && (p == end || isBlank(*p))) {
+      // birdc output ends in the AS path, like [AS13335i], the origin is the last one
+      auto pos = line.rfind("[AS");
+      if(pos != string::npos) {
+        auto digits = line.find_first_not_of("0123456789", pos + 3);
+        label = "AS" + line.substr(pos + 3, digits - pos - 3);
+        if(label.size() == 2)
+          label.clear();
+      }
+      else {
+        auto start = line.find_first_not_of(" \t", p - line.c_str());
+        if(start != string::npos)
+          label = line.substr(start, line.find_first_of(" \t", start) - start);
+      }
+    }
+    if(label.empty()) {
+      if(!malformed++)
+        cerr<<"Warning: malformed line "<<lineno<<" in '"<<fname<<"': "<<line<<endl;
+      continue;
+    }
+    auto iter = labels.insert({label, (uint32_t)names.size()});
+    if(iter.second)
+      names.push_back(label);
+    withLabels.push_back({prefix, iter.first->second});
+  }
+  if(malformed > 1)
+    cerr<<"Warning: skipped "<<malformed<<" malformed lines in '"<<fname<<"'"<<endl;
+  return Strata(labelMostSpecific(std::move(withLabels)), names, space);
+}
+
+int Strata::find(uint32_t ip) const
+{
+  auto iter = upper_bound(d_lookup.begin(), d_lookup.end(), ip, [](uint32_t ip, const pair<PrefixSet::Range, uint32_t>& r) {
+      return ip < r.first.first;
+    });
+  if(iter == d_lookup.begin() || ip > (iter - 1)->first.last)
+    return -1;
+  return (iter - 1)->second;
+}
+
+vector<uint64_t> allocateProbes(const vector<uint64_t>& sizes, const vector<double>& weightsIn, uint64_t total, uint64_t minimum)
+{
+  size_t num = sizes.size();
+  vector<uint64_t> ret(num, 0);
+  vector<double> weights(weightsIn);
+  double sum = 0;
+  for(size_t n = 0; n < num; ++n)
+    sum += sizes[n] ? weights[n] : 0;
+  if(sum <= 0) // nothing to go on, so proportional
+    for(size_t n = 0; n < num; ++n)
+      weights[n] = sizes[n];
+
+  uint64_t need = 0;
+  for(size_t n = 0; n < num; ++n)
+    need += std::min(minimum, sizes[n]);
+  if(need <= total) {
+    for(size_t n = 0; n < num; ++n)
+      ret[n] = std::min(minimum, sizes[n]);
+    total -= need;
+  }
+
+  /* hand out the rest by weight, and whenever a stratum would get more than it has
+     addresses, cap it and spread the surplus over the others */
+  vector<bool> capped(num);
+  for(size_t n = 0; n < num; ++n)
+    capped[n] = ret[n] >= sizes[n] || weights[n] <= 0;
+  vector<double> share(num, 0);
+  for(;;) {
+    double weight = 0;
+    for(size_t n = 0; n < num; ++n)
+      if(!capped[n])
+        weight += weights[n];
+    if(weight <= 0 || !total)
+      break;
+    bool changed = false;
+    for(size_t n = 0; n < num; ++n) {
+      if(capped[n])
+        continue;
+      share[n] = total * weights[n] / weight;
+      if(ret[n] + share[n] >= sizes[n]) {
+        total -= sizes[n] - ret[n];
+        ret[n] = sizes[n];
+        capped[n] = true;
+        changed = true;
+      }
+    }
+    if(changed)
+      continue;
+
+    // whole probes first, then the leftovers to the largest remainders
+    vector<pair<double, size_t>> remainders;
+    for(size_t n = 0; n < num; ++n) {
+      if(capped[n])
+        continue;
+      uint64_t whole = share[n];
+      ret[n] += whole;
+      total -= whole;
+      remainders.push_back({share[n] - whole, n});
+    }
+    sort(remainders.begin(), remainders.end(), [](const pair<double, size_t>& a, const pair<double, size_t>& b) {
+        return a.first > b.first;
+      });
+    for(const auto& r : remainders) {
+      if(!total)
+        break;
+      if(ret[r.second] < sizes[r.second]) {
+        ++ret[r.second];
+        --total;
+      }
+    }
+    break;
+  }
+  return ret;
+}
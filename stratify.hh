@@ -0,0 +1,54 @@
+#pragma once
+#include "estimate.hh"
+#include "prefixset.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** A partition of the space to scan into strata, each of which is sampled on its own.
+
+    Strata can be the /8s, the length of the most specific announced prefix covering an
+    address, or labels from a mapping file, typically the origin AS. Where prefixes
+    overlap, the most specific one decides. Strata outside the space to scan are left out.
+*/
+class Strata
+{
+public:
+  struct Stratum
+  {
+    std::string name;
+    PrefixSet space;
+  };
+
+  static Strata bySlash8(const PrefixSet& space);
+  static Strata byPrefixLength(const std::vector<IPv4Prefix>& prefixes, const PrefixSet& space);
+  /** Lines of 'prefix label', or birdc output, where the label is the origin AS at the
+      end of the AS path. Throws if the file can't be read */
+  static Strata byMapping(const std::string& fname, const PrefixSet& space);
+
+  size_t size() const
+  {
+    return d_strata.size();
+  }
+  const Stratum& operator[](size_t n) const
+  {
+    return d_strata[n];
+  }
+  //<! index of the stratum ip is in, or -1
+  int find(uint32_t ip) const;
+
+private:
+  //! labels are the most specific for every range, ranges are disjoint and sorted
+  Strata(const std::vector<std::pair<PrefixSet::Range, uint32_t>>& labeled, const std::vector<std::string>& names, const PrefixSet& space);
+
+  std::vector<Stratum> d_strata;
+  std::vector<std::pair<PrefixSet::Range, uint32_t>> d_lookup; //<! sorted ranges with their stratum
+};
+
+/** Splits 'total' probes over strata of the given sizes. Each stratum gets a share in
+    proportion to its weight, which is its size for proportional allocation, and size
+    times the standard deviation for Neyman allocation. No stratum gets more probes than
+    it has addresses, and every stratum gets at least 'minimum' if the budget allows.
+*/
+std::vector<uint64_t> allocateProbes(const std::vector<uint64_t>& sizes, const std::vector<double>& weights, uint64_t total, uint64_t minimum = 0);
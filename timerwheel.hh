@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/** Hierarchical timing wheel, as in the Linux kernel: four levels of 256 slots, where
+    level n has a granularity of 256^n ticks. Adding a timer is O(1), and a timer is
+    moved down a level at most three times before it fires.
+
+    Times are in ns, rounded down to ticks of 'resolution' ns. This is not thread safe,
+    every thread that needs timers should own a wheel.
+*/
+template<typename T>
+class TimerWheel
+{
+public:
+  TimerWheel(int64_t resolution, int64_t now) : d_resolution(resolution), d_now(now / resolution)
+  {}
+
+  //! schedules item to fire at 'when', or on the next advance() if that has passed already
+  void add(int64_t when, const T& item)
+  {
+    place(std::max((uint64_t)(when / d_resolution), d_now), item);
+    ++d_size;
+  }
+
+  //! calls expire(item) for every timer due at or before 'now'
+  template<typename F>
+  void advance(int64_t now, F expire)
+  {
+    uint64_t target = now / d_resolution;
+    for(; d_now <= target; ++d_now) {
+      for(unsigned int level = s_levels - 1; level > 0; --level) {
+        if(d_now & ((1ULL << (8 * level)) - 1))
+          continue;
+        std::vector<Entry> cascade;
+        cascade.swap(d_slots[level][(d_now >> (8 * level)) & 255]);
+        for(const auto& e : cascade)
+          place(e.first, e.second);
+      }
+      // expire() may add timers for this very tick, which go into the same slot
+      auto& slot = d_slots[0][d_now & 255];
+      while(!slot.empty()) {
+        std::vector<Entry> due;
+        due.swap(slot);
+        d_size -= due.size();
+        for(const auto& e : due)
+          expire(e.second);
+      }
+    }
+  }
+
+  size_t size() const
+  {
+    return d_size;
+  }
+  bool empty() const
+  {
+    return !d_size;
+  }
+
+private:
+  typedef std::pair<uint64_t, T> Entry;
+  static constexpr unsigned int s_levels = 4;
+
+  void place(uint64_t tick, const T& item)
+  {
+    uint64_t delta = tick - d_now;
+    unsigned int level = 0;
+    while(level < s_levels - 1 && delta >= (1ULL << (8 * (level + 1))))
+      ++level;
+    if(level == s_levels - 1 && delta >= (1ULL << (8 * s_levels))) // beyond the wheel, fire at the far end
+      tick = d_now + (1ULL << (8 * s_levels)) - 1;
+    d_slots[level][(tick >> (8 * level)) & 255].emplace_back(tick, item);
+  }
+
+  const int64_t d_resolution;
+  uint64_t d_now; //<! next tick to process
+  size_t d_size{0};
+  std::vector<Entry> d_slots[s_levels][256];
+};